@@ -11,3 +11,5 @@ u8 common_Bswap8(const u8 data);
 u16 common_Bswap16(const u16 data);
 u32 common_Bswap32(const u32 data);
 u64 common_Bswap64(const u64 data);
+
+void common_Bswap32Array(void* dst, const void* src, const usize count);
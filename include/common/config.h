@@ -5,6 +5,31 @@
 
 #pragma once
 
+#include "common/types.h"
+
 typedef struct common_Config {
     const char* pathDol;
+
+    // Guest cycles between rewind snapshots (0 only captures on request), and their memory budget
+    i64 rewindInterval;
+    usize rewindBudget;
+
+    // Guest cycles between profiler samples, 0 disables profiling
+    i64 profileInterval;
+
+    // Guest cycles between dumps of the host time spent per subsystem, 0 disables accounting
+    i64 statsInterval;
+
+    // Write compiled blocks to /tmp/perf-<pid>.map for host profilers
+    int perfMap;
+
+    // Check compiled blocks against the interpreter
+    int lockstep;
+
+    // Log of nondeterministic inputs to write, or to play back instead of asking the host
+    const char* pathRecord;
+    const char* pathReplay;
+
+    // Track which instructions of the DOL's text sections have been executed
+    int coverage;
 } common_Config;
@@ -0,0 +1,14 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+#include "common/types.h"
+
+// Worst case size of an encoded delta
+#define COMMON_MAX_DELTA_SIZE(size) ((size) + (size) / 2)
+
+usize common_EncodeXorDelta(const u8* old, const u8* new, const usize size, u8* out);
+void common_ApplyXorDelta(const u8* delta, const usize sizeDelta, u8* dst);
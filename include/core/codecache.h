@@ -0,0 +1,81 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+#include "common/types.h"
+
+#define CODECACHE_MAX_INSTRS (64)
+
+enum {
+    CODECACHE_LINK_TAKEN,
+    CODECACHE_LINK_FALLTHROUGH,
+    CODECACHE_NUM_LINKS,
+};
+
+typedef struct codecache_Op codecache_Op;
+
+typedef void (*codecache_Handler)(const u32 instr);
+typedef void (*codecache_FusedHandler)(const codecache_Op* op);
+
+struct codecache_Op {
+    codecache_Handler handler;
+
+    // Superinstruction covering this op and the next numFused - 1 ops
+    codecache_FusedHandler fused;
+
+    u32 instr;
+    u32 numFused;
+};
+
+typedef struct codecache_Block codecache_Block;
+
+typedef int (*codecache_Runner)(const codecache_Block* block);
+
+struct codecache_Block {
+    u32 addr; // Physical address of the first instruction
+    u32 gen;  // Page generation at compile time
+
+    // Successors, only valid while linkEpoch matches the code cache epoch.
+    // The taken link doubles as an inline cache for indirect branches
+    codecache_Block* links[CODECACHE_NUM_LINKS];
+    u32 linkIa[CODECACHE_NUM_LINKS];
+    u32 linkEpoch;
+
+    // Host code that calls the runner with this block, so host profilers can tell blocks apart.
+    // NULL without a perf map
+    codecache_Runner trampoline;
+
+    u32 numOps;
+
+    codecache_Op ops[];
+};
+
+void codecache_Initialize();
+void codecache_Reset();
+void codecache_Shutdown();
+
+// Gives compiled blocks trampolines and lists them in /tmp/perf-<pid>.map if perfMap is set
+void codecache_SetConfig(const int perfMap);
+
+// Function that runs compiled blocks, trampolines call it
+void codecache_SetRunner(const codecache_Runner runner);
+
+// Threads don't survive fork(), the worker must be stopped around it
+void codecache_Suspend();
+void codecache_Resume();
+
+codecache_Block* codecache_Lookup(const u32 addr);
+
+void codecache_Invalidate(const u32 addr, const u32 size);
+
+u32 codecache_GetEpoch();
+void codecache_Unlink();
+
+codecache_Block* codecache_GetLink(codecache_Block* block, const u32 ia);
+void codecache_SetLink(codecache_Block* block, const int link, const u32 ia, codecache_Block* target);
+
+void codecache_PushReturn(codecache_Block* caller, const u32 ia);
+codecache_Block* codecache_PopReturn(const u32 ia);
@@ -0,0 +1,24 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+#include "common/types.h"
+
+void coverage_Initialize();
+void coverage_Reset();
+void coverage_Shutdown();
+
+// Tracks which instruction words of the DOL's text sections have been executed
+void coverage_SetConfig(const int enabled);
+
+// Adds a text section at a virtual address, sections are cleared on reset
+void coverage_AddSection(const int index, const u32 addr, const u32 size);
+
+// Marks numInstrs consecutive instructions starting at a physical address as executed
+void coverage_Mark(const u32 addr, const u32 numInstrs);
+
+// Writes the executed address ranges per section to path and prints a summary
+void coverage_WriteReport(const char* path);
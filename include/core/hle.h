@@ -8,8 +8,9 @@
 #include "common/types.h"
 
 enum {
-    IOS_NG = -1,
-    IOS_OK =  0,
+    IOS_EQUEUEFULL = -8,
+    IOS_NG         = -1,
+    IOS_OK         =  0,
 };
 
 void hle_Initialize();
@@ -0,0 +1,41 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+#include "common/types.h"
+
+enum {
+    HOSTIO_READ,
+    HOSTIO_WRITE,
+};
+
+void hostio_Initialize();
+void hostio_Reset();
+void hostio_Shutdown();
+
+// Finishes every queued request and stops the workers, results are kept for hostio_Complete
+void hostio_Suspend();
+void hostio_Resume();
+
+// Hands a transfer to the worker pool, which takes ownership of buf. Returns a ticket,
+// or 0 if the request couldn't be queued and has to be redone with hostio_Transfer.
+// Results are kept until hostio_Complete or hostio_CancelAll, a full pool fails the submit
+u64 hostio_Submit(const int type, const int host, const u64 offset, u8* buf, const u32 size);
+
+// Requests on the same host file run one at a time in the order they were submitted.
+// Waits until all of them have finished, call this before transferring on it directly
+void hostio_Wait(const int host);
+
+// Waits for a request to finish, returns its buffer (now owned by the caller) and the number
+// of bytes transferred. Returns NULL if the ticket is unknown or was cancelled
+u8* hostio_Complete(const u64 ticket, i64* result);
+
+// Drops every request, their owners have to redo them with hostio_Transfer.
+// Unfinished requests still run, so later transfers on the same files can't overtake them
+void hostio_CancelAll();
+
+// Transfers size bytes at offset of a host file, returns the number of bytes transferred or -1
+i64 hostio_Transfer(const int type, const int host, const u64 offset, u8* buf, const u32 size);
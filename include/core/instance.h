@@ -0,0 +1,58 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+#include "common/types.h"
+
+#include "nouwii.h"
+
+enum {
+    INSTANCE_CODECACHE,
+    INSTANCE_COVERAGE,
+    INSTANCE_HLE,
+    INSTANCE_HOSTIO,
+    INSTANCE_LOADER,
+    INSTANCE_MEMORY,
+    INSTANCE_PROFILER,
+    INSTANCE_REPLAY,
+    INSTANCE_REWIND,
+    INSTANCE_SCHEDULER,
+    INSTANCE_STATS,
+    INSTANCE_AI,
+    INSTANCE_BROADWAY,
+    INSTANCE_DI,
+    INSTANCE_DSP,
+    INSTANCE_EXI,
+    INSTANCE_HOLLYWOOD,
+    INSTANCE_IPC,
+    INSTANCE_PI,
+    INSTANCE_NUM_MODULES,
+};
+
+struct nouwii_Instance {
+    void* contexts[INSTANCE_NUM_MODULES];
+
+    usize sizes[INSTANCE_NUM_MODULES];
+};
+
+// Instance emulated by the calling thread
+extern _Thread_local nouwii_Instance* instance_current;
+
+// Copy of the current instance's contexts, saves a load on every access
+extern _Thread_local void* instance_contexts[INSTANCE_NUM_MODULES];
+
+// Module state of the current instance, modules define ctx with this
+#define INSTANCE_CONTEXT(module, type) (*(type*)instance_contexts[module])
+
+nouwii_Instance* instance_Create();
+void instance_Destroy(nouwii_Instance* instance);
+
+void instance_MakeCurrent(nouwii_Instance* instance);
+
+void instance_CreateContext(const int module, const usize size);
+void instance_DestroyContext(const int module);
+
+void* instance_GetContext(const int module, usize* size);
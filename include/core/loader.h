@@ -7,6 +7,9 @@
 
 #include "common/types.h"
 
+void loader_Initialize();
+void loader_Shutdown();
+
 void loader_SetDolPath(const char* path);
 void loader_LoadDol();
 
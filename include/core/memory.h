@@ -7,9 +7,32 @@
 
 #include "common/types.h"
 
+// RAM pages are numbered from the start of MEM1, followed by MEM2
+#define MEMORY_SIZE_PAGE (0x1000)
+#define MEMORY_NUM_RAM_PAGES ((0x1800000 + 0x4000000) / MEMORY_SIZE_PAGE)
+#define MEMORY_SIZE_DIRTY_BITMAP (MEMORY_NUM_RAM_PAGES / 64)
+
 #define MAKEDECL_READ(size) u##size memory_Read##size(const u32 addr);
 #define MAKEDECL_WRITE(size) void memory_Write##size(const u32 addr, const u##size data);
 
+// Consumers of dirty page tracking, each one collects its own set of pages
+enum {
+    MEMORY_DIRTY_REWIND,
+    MEMORY_DIRTY_LOCKSTEP,
+    MEMORY_NUM_DIRTY_TRACKERS,
+};
+
+enum {
+    MEMORY_WATCH_READ  = 1 << 0,
+    MEMORY_WATCH_WRITE = 1 << 1,
+};
+
+// Called on accesses to unmapped addresses, doesn't return if the fault is handled
+typedef void (*memory_FaultHandler)(const u32 addr, const int write);
+
+// Called after an access that hit a watchpoint
+typedef void (*memory_WatchHandler)(const u32 addr, const u32 size, const u64 data, const int write);
+
 void memory_Initialize();
 void memory_Reset();
 void memory_Shutdown();
@@ -25,5 +48,49 @@ MAKEDECL_WRITE(32)
 MAKEDECL_WRITE(64)
 
 void memory_Map(u8* mem, const u32 addr, const u32 size, const int read, const int write);
+void memory_Unmap(const u32 addr, const u32 size);
 
 void* memory_GetPointer(const u32 addr);
+void* memory_GetSpan(const u32 addr, const u32 size, const int write);
+
+// Bulk accesses to physical memory, these may cross pages and hit I/O. Writes
+// invalidate compiled code and are seen by dirty tracking and watchpoints
+void memory_CopyToGuest(const u32 addr, const void* data, const u32 size);
+void memory_CopyFromGuest(void* data, const u32 addr, const u32 size);
+
+// Same as above, but for arrays of big endian words
+void memory_CopyToGuest32(const u32 addr, const u32* data, const u32 count);
+void memory_CopyFromGuest32(u32* data, const u32 addr, const u32 count);
+
+void memory_FillGuest(const u32 addr, const u8 data, const u32 size);
+
+// Same semantics as strncpy, the guest string is padded with zeros
+void memory_CopyStringToGuest(const u32 addr, const char* str, const u32 size);
+
+// Copies at most size - 1 characters, the host string is always terminated
+void memory_CopyStringFromGuest(char* str, const u32 addr, const u32 size);
+
+int memory_ProtectCode(const u32 addr);
+int memory_IsCodeProtected(const u32 addr);
+void memory_UnprotectCode(const u32 addr);
+
+// Copies out the bitmap of RAM pages written to since the tracker's last collection and clears it.
+// Tracking starts with the first collection of any tracker, until then no page is reported as dirty
+void memory_CollectDirty(const int tracker, u64* bitmap);
+
+// Reports a RAM page the host wrote to directly to all trackers
+void memory_MarkDirty(const u32 ramPage);
+
+// Number of I/O and unmapped accesses so far, these may have side effects
+u64 memory_GetNumIoAccesses();
+
+u8* memory_GetRamPage(const u32 ramPage);
+u32 memory_GetRamPageAddr(const u32 ramPage);
+
+void memory_SetFaultHandler(const memory_FaultHandler handler);
+
+// Watchpoints on physical addresses, only accesses to the watched pages are slowed down
+void memory_AddWatchpoint(const u32 addr, const u32 size, const int type);
+void memory_ClearWatchpoints();
+
+void memory_SetWatchHandler(const memory_WatchHandler handler);
@@ -0,0 +1,24 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+#include "common/types.h"
+
+void profiler_Initialize();
+void profiler_Reset();
+void profiler_Shutdown();
+
+// Samples CIA and LR every interval guest cycles, 0 disables profiling
+void profiler_SetConfig(const i64 interval);
+
+// Loads the CodeWarrior/Dolphin symbol map next to the DOL, if there is one
+void profiler_LoadSymbols(const char* pathDol);
+
+// Returns the name of the function containing addr, or NULL if there is none
+const char* profiler_GetSymbol(const u32 addr);
+
+// Writes collapsed stacks to path and prints the top functions
+void profiler_WriteReport(const char* path);
@@ -0,0 +1,27 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+#include "common/types.h"
+
+// Nondeterministic inputs, new ones go at the end to keep old logs readable
+enum {
+    REPLAY_INPUT_FILE_READ,
+};
+
+void replay_Initialize();
+void replay_Reset();
+void replay_Shutdown();
+
+// Records inputs to pathRecord or plays them back from pathReplay, either may be NULL
+void replay_SetConfig(const char* pathRecord, const char* pathReplay);
+
+// Returns true if inputs come from a log, the host doesn't have to provide them
+int replay_IsReplaying();
+
+// Appends host input to the log, or overwrites it with the logged input when
+// replaying. Stops emulation if the guest asks for input the log doesn't have
+void replay_Input(const int type, void* data, const u32 size);
@@ -0,0 +1,22 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+#include "common/types.h"
+
+void rewind_Initialize();
+void rewind_Reset();
+void rewind_Shutdown();
+
+// Captures a snapshot every interval guest cycles, 0 disables periodic snapshots.
+// Old snapshots are dropped to keep their total size within the budget
+void rewind_SetConfig(const i64 interval, const usize budget);
+
+// Captures a snapshot now, on top of the periodic ones
+void rewind_Capture();
+
+// Returns to the newest snapshot and discards it, returns false if there is none
+int rewind_StepBack();
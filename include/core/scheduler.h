@@ -7,6 +7,9 @@
 
 #include "common/types.h"
 
+// Events that can be pending at once. Modules with an event per request must leave room for the others
+#define SCHEDULER_MAX_EVENTS (64)
+
 typedef void (*scheduler_Callback)(const int);
 
 void scheduler_Initialize();
@@ -16,3 +19,6 @@ void scheduler_Shutdown();
 void scheduler_ScheduleEvent(const char* name, scheduler_Callback callback, const int arg, const i64 cycles);
 
 void scheduler_Run();
+
+// Guest cycles executed since reset
+i64 scheduler_GetTimestamp();
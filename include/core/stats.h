@@ -0,0 +1,27 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+#include "common/types.h"
+
+// Open timing scope, start is 0 if accounting is disabled
+typedef struct stats_Scope {
+    u64 start;
+
+    int depth;
+} stats_Scope;
+
+void stats_Initialize();
+void stats_Reset();
+void stats_Shutdown();
+
+// Dumps and clears the counters every interval guest cycles, 0 disables accounting
+void stats_SetConfig(const i64 interval);
+
+stats_Scope stats_Begin();
+
+// Adds the host time spent in the scope, minus nested scopes, to the counter for name and id
+void stats_End(const stats_Scope scope, const char* name, const u32 id);
@@ -7,14 +7,53 @@
 
 #include "common/types.h"
 
+#include "core/codecache.h"
+
 void broadway_Initialize();
 void broadway_Reset();
 void broadway_Shutdown();
 
+// Checks every compiled block against the interpreter, stops at the first divergence
+void broadway_SetConfig(const int lockstep);
+
 void broadway_Run();
 
 void broadway_SetEntry(const u32 addr);
 
-void broadway_TryInterrupt();
+u32 broadway_GetCia();
+u32 broadway_GetLr();
+
+void broadway_SetInterruptPending();
 
 i64* broadway_GetCyclesToRun();
+
+void broadway_CompleteDma(const int gen);
+
+codecache_Block* broadway_CompileBlock(const u8* code, const u32 maxInstrs);
+
+// Guest registers, for tests that drive the CPU directly
+typedef struct broadway_State {
+    u32 ia;
+
+    u32 r[32];
+
+    // PS0 and PS1 as raw doubles
+    u64 fprs[32][2];
+
+    u32 cr, fpscr, xer, lr, ctr, msr, hid2;
+
+    u64 tbr;
+} broadway_State;
+
+void broadway_GetState(broadway_State* state);
+void broadway_SetState(const broadway_State* state);
+
+// Executes instr as if it had been fetched from IA, returns false if it isn't implemented
+int broadway_Execute(const u32 instr);
+
+// Interprets numInstrs instructions from IA, or fewer if a storage exception is taken
+void broadway_Interpret(const i64 numInstrs);
+
+// Runs a compiled block like the dispatcher with cyclesToRun left in the slice, returns
+// whether it completed. broadway_GetCyclesToRun() has the cycles left afterwards
+int broadway_RunBlock(const codecache_Block* block, const i64 cyclesToRun);
@@ -5,10 +5,34 @@
 
 #pragma once
 
+#include <sys/types.h>
+
 #include "common/config.h"
+#include "common/types.h"
+
+// Independent emulator, instances can run concurrently on separate threads
+typedef struct nouwii_Instance nouwii_Instance;
+
+nouwii_Instance* nouwii_Initialize(const common_Config* config);
+void nouwii_Reset(nouwii_Instance* instance);
+void nouwii_Shutdown(nouwii_Instance* instance);
+
+void nouwii_Run(nouwii_Instance* instance);
+
+// Runs for at least the given number of guest cycles
+void nouwii_RunCycles(nouwii_Instance* instance, const i64 cycles);
+
+// Captures a rewind snapshot now, whether or not periodic snapshots are enabled
+void nouwii_Capture(nouwii_Instance* instance);
+
+// Returns to the newest rewind snapshot and discards it, returns false if there is none
+int nouwii_StepBack(nouwii_Instance* instance);
+
+// Writes the profiler's collapsed stacks to path and prints the top functions
+void nouwii_WriteProfile(nouwii_Instance* instance, const char* path);
 
-void nouwii_Initialize(const common_Config* config);
-void nouwii_Reset();
-void nouwii_Shutdown();
+// Writes the executed address ranges of the DOL's text sections to path and prints a summary
+void nouwii_WriteCoverage(nouwii_Instance* instance, const char* path);
 
-void nouwii_Run();
+// Like fork(), the child continues with a copy-on-write copy of the instance
+pid_t nouwii_Fork(nouwii_Instance* instance);
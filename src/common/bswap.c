@@ -5,6 +5,8 @@
 
 #include "common/bswap.h"
 
+#include <string.h>
+
 u8 common_Bswap8(const u8 data) {
     return data;
 }
@@ -26,3 +28,15 @@ u64 common_Bswap64(const u64 data) {
 
     return n;
 }
+
+void common_Bswap32Array(void* dst, const void* src, const usize count) {
+    // Simple enough for the compiler to vectorize
+    for (usize i = 0; i < count; i++) {
+        u32 data;
+        memcpy(&data, (const u8*)src + sizeof(u32) * i, sizeof(u32));
+
+        data = common_Bswap32(data);
+
+        memcpy((u8*)dst + sizeof(u32) * i, &data, sizeof(u32));
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "common/delta.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Deltas are a list of runs, each one is a 16-bit count of unchanged words,
+// a 16-bit count of changed words, then the changed words XORed with the old data
+
+typedef struct Run {
+    u16 numSkipped;
+    u16 numChanged;
+} Run;
+
+usize common_EncodeXorDelta(const u8* old, const u8* new, const usize size, u8* out) {
+    assert((size % sizeof(u64)) == 0);
+    assert((size / sizeof(u64)) <= UINT16_MAX);
+
+    const usize numWords = size / sizeof(u64);
+
+    usize sizeDelta = 0;
+
+    for (usize word = 0; word < numWords;) {
+        Run run = {0, 0};
+
+        while ((word < numWords) && (memcmp(&old[sizeof(u64) * word], &new[sizeof(u64) * word], sizeof(u64)) == 0)) {
+            run.numSkipped++;
+            word++;
+        }
+
+        if (word == numWords) {
+            // Trailing unchanged words are implied
+            break;
+        }
+
+        u8* runHeader = &out[sizeDelta];
+
+        sizeDelta += sizeof(Run);
+
+        while ((word < numWords) && (memcmp(&old[sizeof(u64) * word], &new[sizeof(u64) * word], sizeof(u64)) != 0)) {
+            u64 a, b;
+
+            memcpy(&a, &old[sizeof(u64) * word], sizeof(u64));
+            memcpy(&b, &new[sizeof(u64) * word], sizeof(u64));
+
+            const u64 x = a ^ b;
+
+            memcpy(&out[sizeDelta], &x, sizeof(u64));
+
+            sizeDelta += sizeof(u64);
+
+            run.numChanged++;
+            word++;
+        }
+
+        memcpy(runHeader, &run, sizeof(Run));
+    }
+
+    return sizeDelta;
+}
+
+void common_ApplyXorDelta(const u8* delta, const usize sizeDelta, u8* dst) {
+    usize offset = 0;
+
+    for (usize i = 0; i < sizeDelta;) {
+        Run run;
+
+        memcpy(&run, &delta[i], sizeof(Run));
+
+        i += sizeof(Run);
+
+        offset += sizeof(u64) * run.numSkipped;
+
+        for (u16 word = 0; word < run.numChanged; word++) {
+            u64 a, x;
+
+            memcpy(&a, &dst[offset], sizeof(u64));
+            memcpy(&x, &delta[i], sizeof(u64));
+
+            a ^= x;
+
+            memcpy(&dst[offset], &a, sizeof(u64));
+
+            offset += sizeof(u64);
+            i += sizeof(u64);
+        }
+    }
+}
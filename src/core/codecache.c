@@ -0,0 +1,497 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "core/codecache.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "core/instance.h"
+#include "core/memory.h"
+#include "core/profiler.h"
+
+#include "hw/broadway.h"
+
+#define SIZE_PAGE (0x1000)
+#define NUM_PAGES (0x100000)
+
+#define SIZE_TABLE (0x10000)
+#define SIZE_QUEUE (0x100)
+#define SIZE_RAS   (0x10)
+
+#define MAX_PERF_MAP_PATH (64)
+
+#define SIZE_TRAMPOLINE  (32)
+#define SIZE_TRAMPOLINES (0x1000000)
+
+// Number of dispatcher misses before a block is handed to the worker
+#define HOT_THRESHOLD (16)
+
+typedef struct ReturnAddress {
+    codecache_Block* caller;
+
+    u32 ia;
+    u32 epoch;
+} ReturnAddress;
+
+typedef struct Context {
+    // Written by the worker (NULL -> block) and the emulation thread (block -> NULL)
+    _Atomic(codecache_Block*)* table;
+
+    // Bumped by the emulation thread whenever a code page changes
+    _Atomic(u32)* gens;
+
+    // Emulation thread only
+    u16* hotness;
+
+    // Bumped whenever a block is freed or invalidated, or address translation changes
+    u32 epoch;
+
+    // Return address prediction stack
+    ReturnAddress ras[SIZE_RAS];
+
+    u32 rasTop;
+
+    // Hot block queue, single producer (emulation thread) and single consumer (worker)
+    u32 queue[SIZE_QUEUE];
+
+    _Atomic(u32) head;
+    _Atomic(u32) tail;
+
+    pthread_t worker;
+    sem_t semaphore;
+
+    atomic_int running;
+
+    // Worker only, reopened after fork so every process gets its own map
+    int perfMap;
+
+    FILE* perfFile;
+    pid_t perfPid;
+
+    codecache_Runner runner;
+
+    // Executable, slots are handed out once and never reused so map entries stay valid
+    u8* trampolines;
+
+    usize sizeTrampolines;
+} Context;
+
+#define ctx INSTANCE_CONTEXT(INSTANCE_CODECACHE, Context)
+
+static u32 GetIndex(const u32 addr) {
+    return (addr / sizeof(u32)) & (SIZE_TABLE - 1);
+}
+
+static int IsValid(const codecache_Block* block) {
+    return block->gen == atomic_load_explicit(&ctx.gens[block->addr / SIZE_PAGE], memory_order_relaxed);
+}
+
+static void Evict(const u32 idx, codecache_Block* block) {
+    // Only the emulation thread removes blocks, so this can't race with another eviction
+    if (atomic_compare_exchange_strong(&ctx.table[idx], &block, NULL)) {
+        free(block);
+
+        ctx.epoch++;
+    }
+}
+
+static int PushRequest(const u32 addr) {
+    const u32 tail = atomic_load_explicit(&ctx.tail, memory_order_relaxed);
+    const u32 head = atomic_load_explicit(&ctx.head, memory_order_acquire);
+
+    if ((tail - head) == SIZE_QUEUE) {
+        // Queue is full, the block will become hot again later
+        return NOUWII_FALSE;
+    }
+
+    ctx.queue[tail & (SIZE_QUEUE - 1)] = addr;
+
+    atomic_store_explicit(&ctx.tail, tail + 1, memory_order_release);
+
+    return NOUWII_TRUE;
+}
+
+static int PopRequest(u32* addr) {
+    const u32 head = atomic_load_explicit(&ctx.head, memory_order_relaxed);
+    const u32 tail = atomic_load_explicit(&ctx.tail, memory_order_acquire);
+
+    if (head == tail) {
+        return NOUWII_FALSE;
+    }
+
+    *addr = ctx.queue[head & (SIZE_QUEUE - 1)];
+
+    atomic_store_explicit(&ctx.head, head + 1, memory_order_release);
+
+    return NOUWII_TRUE;
+}
+
+static void ClosePerfMap() {
+    if (ctx.perfFile != NULL) {
+        fclose(ctx.perfFile);
+
+        ctx.perfFile = NULL;
+    }
+}
+
+// Returns a trampoline that calls the runner with the block, or NULL if there is no room left
+static codecache_Runner EmitTrampoline() {
+    if (ctx.sizeTrampolines == SIZE_TRAMPOLINES) {
+        return NULL;
+    }
+
+    u8* code = &ctx.trampolines[ctx.sizeTrampolines];
+
+    ctx.sizeTrampolines += SIZE_TRAMPOLINE;
+
+    if (ctx.sizeTrampolines == SIZE_TRAMPOLINES) {
+        printf("Code cache Out of trampolines, new blocks won't show up in the perf map\n");
+    }
+
+    const u64 runner = (uintptr_t)ctx.runner;
+
+    usize size = 0;
+
+    // push rbp; mov rbp, rsp. The frame keeps the stack aligned and frame pointer unwinding working
+    code[size++] = 0x55;
+    code[size++] = 0x48;
+    code[size++] = 0x89;
+    code[size++] = 0xE5;
+
+    // movabs rax, runner
+    code[size++] = 0x48;
+    code[size++] = 0xB8;
+
+    memcpy(&code[size], &runner, sizeof(runner));
+
+    size += sizeof(runner);
+
+    // call rax. The block is still in rdi, and the return address in the trampoline names it
+    code[size++] = 0xFF;
+    code[size++] = 0xD0;
+
+    // pop rbp; ret
+    code[size++] = 0x5D;
+    code[size++] = 0xC3;
+
+    memset(&code[size], 0xCC, SIZE_TRAMPOLINE - size);
+
+    return (codecache_Runner)(void*)code;
+}
+
+static void WritePerfMap(const u32 addr, const codecache_Runner trampoline) {
+
+    if ((ctx.perfFile == NULL) || (ctx.perfPid != getpid())) {
+        ClosePerfMap();
+
+        ctx.perfPid = getpid();
+
+        char path[MAX_PERF_MAP_PATH];
+
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)ctx.perfPid);
+
+        ctx.perfFile = fopen(path, "w");
+
+        if (ctx.perfFile == NULL) {
+            printf("Code cache Unable to open %s\n", path);
+            exit(1);
+        }
+    }
+
+    // Handlers run below the trampoline, "perf record -g" charges them to the block
+    fprintf(ctx.perfFile, "%llx %x guest_%08X", (unsigned long long)(uintptr_t)trampoline, SIZE_TRAMPOLINE, addr);
+
+    const char* symbol = profiler_GetSymbol(addr);
+
+    if (symbol != NULL) {
+        fprintf(ctx.perfFile, "_%s", symbol);
+    }
+
+    fputc('\n', ctx.perfFile);
+
+    // Workers of forked jobs leave through _exit()
+    fflush(ctx.perfFile);
+}
+
+static void Compile(const u32 addr) {
+    const u32 idx = GetIndex(addr);
+
+    if (atomic_load_explicit(&ctx.table[idx], memory_order_acquire) != NULL) {
+        // Already compiled, or the slot is still in use
+        return;
+    }
+
+    // Sample the generation before reading any code. If the page is written after this,
+    // the block is published with an old generation and rejected by the dispatcher
+    const u32 gen = atomic_load(&ctx.gens[addr / SIZE_PAGE]);
+
+    if (!memory_IsCodeProtected(addr)) {
+        // Page was written to since the request, writes would go unnoticed
+        return;
+    }
+
+    const u32 maxInstrs = (SIZE_PAGE - (addr & (SIZE_PAGE - 1))) / sizeof(u32);
+
+    codecache_Block* block = broadway_CompileBlock(memory_GetPointer(addr), (maxInstrs < CODECACHE_MAX_INSTRS) ? maxInstrs : CODECACHE_MAX_INSTRS);
+
+    if (block == NULL) {
+        return;
+    }
+
+    block->addr = addr;
+    block->gen = gen;
+    block->trampoline = (ctx.perfMap) ? EmitTrampoline() : NULL;
+
+    // The emulation thread may free the block as soon as it's published
+    const codecache_Runner trampoline = block->trampoline;
+
+    codecache_Block* expected = NULL;
+
+    if (!atomic_compare_exchange_strong_explicit(&ctx.table[idx], &expected, block, memory_order_release, memory_order_relaxed)) {
+        // Block was never visible to the emulation thread
+        free(block);
+
+        return;
+    }
+
+    if (trampoline != NULL) {
+        WritePerfMap(addr, trampoline);
+    }
+}
+
+static void* Worker(void* arg) {
+    // The worker compiles blocks of the instance that started it
+    instance_MakeCurrent(arg);
+
+    while (NOUWII_TRUE) {
+        sem_wait(&ctx.semaphore);
+
+        if (!atomic_load(&ctx.running)) {
+            break;
+        }
+
+        u32 addr;
+
+        while (PopRequest(&addr)) {
+            Compile(addr);
+        }
+    }
+
+    return NULL;
+}
+
+static void StartWorker() {
+    atomic_store(&ctx.running, NOUWII_TRUE);
+
+    if (pthread_create(&ctx.worker, NULL, Worker, instance_current) != 0) {
+        printf("Code cache Failed to create worker thread\n");
+        exit(1);
+    }
+}
+
+static void StopWorker() {
+    if (!atomic_load(&ctx.running)) {
+        return;
+    }
+
+    atomic_store(&ctx.running, NOUWII_FALSE);
+
+    sem_post(&ctx.semaphore);
+
+    pthread_join(ctx.worker, NULL);
+}
+
+static void FreeBlocks() {
+    for (u32 idx = 0; idx < SIZE_TABLE; idx++) {
+        free(atomic_exchange(&ctx.table[idx], NULL));
+    }
+
+    ctx.epoch++;
+}
+
+void codecache_Initialize() {
+    instance_CreateContext(INSTANCE_CODECACHE, sizeof(Context));
+
+    ctx.table = calloc(SIZE_TABLE, sizeof(*ctx.table));
+    ctx.gens = calloc(NUM_PAGES, sizeof(*ctx.gens));
+    ctx.hotness = calloc(SIZE_TABLE, sizeof(*ctx.hotness));
+
+    sem_init(&ctx.semaphore, 0, 0);
+}
+
+void codecache_Reset() {
+    StopWorker();
+    FreeBlocks();
+
+    memset(ctx.hotness, 0, SIZE_TABLE * sizeof(*ctx.hotness));
+    memset(ctx.ras, 0, sizeof(ctx.ras));
+
+    ctx.rasTop = 0;
+
+    atomic_store(&ctx.head, 0);
+    atomic_store(&ctx.tail, 0);
+
+    StartWorker();
+}
+
+void codecache_Shutdown() {
+    StopWorker();
+    FreeBlocks();
+
+    ClosePerfMap();
+
+    if (ctx.trampolines != NULL) {
+        munmap(ctx.trampolines, SIZE_TRAMPOLINES);
+    }
+
+    sem_destroy(&ctx.semaphore);
+
+    free(ctx.table);
+    free(ctx.gens);
+    free(ctx.hotness);
+
+    instance_DestroyContext(INSTANCE_CODECACHE);
+}
+
+void codecache_SetConfig(const int perfMap) {
+    ctx.perfMap = NOUWII_FALSE;
+
+    if (!perfMap || (ctx.trampolines != NULL)) {
+        ctx.perfMap = perfMap;
+
+        return;
+    }
+
+#if defined(__x86_64__)
+    void* trampolines = mmap(NULL, SIZE_TRAMPOLINES, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (trampolines == MAP_FAILED) {
+        printf("Code cache Unable to allocate executable memory, no perf map\n");
+
+        return;
+    }
+
+    ctx.trampolines = trampolines;
+    ctx.perfMap = NOUWII_TRUE;
+#else
+    printf("Code cache Perf maps need an x86-64 host\n");
+#endif
+}
+
+void codecache_SetRunner(const codecache_Runner runner) {
+    ctx.runner = runner;
+}
+
+void codecache_Suspend() {
+    StopWorker();
+}
+
+void codecache_Resume() {
+    StartWorker();
+}
+
+codecache_Block* codecache_Lookup(const u32 addr) {
+    const u32 idx = GetIndex(addr);
+
+    codecache_Block* block = atomic_load_explicit(&ctx.table[idx], memory_order_acquire);
+
+    if (block != NULL) {
+        if (!IsValid(block)) {
+            Evict(idx, block);
+
+            block = NULL;
+        } else if (block->addr == addr) {
+            return block;
+        }
+    }
+
+    ctx.hotness[idx]++;
+
+    if ((ctx.hotness[idx] % HOT_THRESHOLD) == 0) {
+        if (block != NULL) {
+            // Make room for the hotter block
+            Evict(idx, block);
+        }
+
+        if (memory_ProtectCode(addr) && PushRequest(addr)) {
+            sem_post(&ctx.semaphore);
+        }
+    }
+
+    return NULL;
+}
+
+void codecache_Invalidate(const u32 addr, const u32 size) {
+    assert(size != 0);
+
+    const u32 lastPage = (u32)(((u64)addr + size - 1) / SIZE_PAGE);
+
+    for (u32 page = addr / SIZE_PAGE; page <= lastPage; page++) {
+        atomic_fetch_add(&ctx.gens[page], 1);
+    }
+
+    // Drop all links, this catches links into the invalidated blocks
+    ctx.epoch++;
+}
+
+u32 codecache_GetEpoch() {
+    return ctx.epoch;
+}
+
+void codecache_Unlink() {
+    ctx.epoch++;
+}
+
+codecache_Block* codecache_GetLink(codecache_Block* block, const u32 ia) {
+    if (block->linkEpoch != ctx.epoch) {
+        return NULL;
+    }
+
+    for (int link = 0; link < CODECACHE_NUM_LINKS; link++) {
+        if ((block->links[link] != NULL) && (block->linkIa[link] == ia)) {
+            return block->links[link];
+        }
+    }
+
+    return NULL;
+}
+
+void codecache_SetLink(codecache_Block* block, const int link, const u32 ia, codecache_Block* target) {
+    if (block->linkEpoch != ctx.epoch) {
+        memset(block->links, 0, sizeof(block->links));
+
+        block->linkEpoch = ctx.epoch;
+    }
+
+    block->links[link] = target;
+    block->linkIa[link] = ia;
+}
+
+void codecache_PushReturn(codecache_Block* caller, const u32 ia) {
+    ReturnAddress* ra = &ctx.ras[ctx.rasTop++ & (SIZE_RAS - 1)];
+
+    ra->caller = caller;
+    ra->ia = ia;
+    ra->epoch = ctx.epoch;
+}
+
+codecache_Block* codecache_PopReturn(const u32 ia) {
+    const ReturnAddress* ra = &ctx.ras[--ctx.rasTop & (SIZE_RAS - 1)];
+
+    if ((ra->ia != ia) || (ra->epoch != ctx.epoch)) {
+        // Misprediction, or the caller may be gone
+        return NULL;
+    }
+
+    return ra->caller;
+}
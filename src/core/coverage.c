@@ -0,0 +1,165 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "core/coverage.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/buffer.h"
+
+#include "core/instance.h"
+
+#define MAX_SECTIONS (7)
+
+typedef struct Section {
+    int index;
+
+    // Virtual for the report, physical for marking
+    u32 addr;
+    u32 addrPhysical;
+
+    u32 numWords;
+
+    // One bit per instruction word
+    u64* bitmap;
+} Section;
+
+typedef struct Context {
+    int enabled;
+
+    Section sections[MAX_SECTIONS];
+
+    int numSections;
+} Context;
+
+#define ctx INSTANCE_CONTEXT(INSTANCE_COVERAGE, Context)
+
+static int IsWordSet(const Section* section, const u32 word) {
+    return (section->bitmap[word / 64] & ((u64)1 << (word & 63))) != 0;
+}
+
+static u32 CountWords(const Section* section) {
+    u32 count = 0;
+
+    for (u32 i = 0; i < ((section->numWords + 63) / 64); i++) {
+        count += __builtin_popcountll(section->bitmap[i]);
+    }
+
+    return count;
+}
+
+static void FreeSections() {
+    for (int i = 0; i < ctx.numSections; i++) {
+        free(ctx.sections[i].bitmap);
+    }
+
+    memset(ctx.sections, 0, sizeof(ctx.sections));
+
+    ctx.numSections = 0;
+}
+
+void coverage_Initialize() {
+    instance_CreateContext(INSTANCE_COVERAGE, sizeof(Context));
+}
+
+void coverage_Reset() {
+    // The loader adds the sections again
+    FreeSections();
+}
+
+void coverage_Shutdown() {
+    FreeSections();
+
+    instance_DestroyContext(INSTANCE_COVERAGE);
+}
+
+void coverage_SetConfig(const int enabled) {
+    ctx.enabled = enabled;
+}
+
+void coverage_AddSection(const int index, const u32 addr, const u32 size) {
+    if (!ctx.enabled) {
+        return;
+    }
+
+    assert(ctx.numSections < MAX_SECTIONS);
+
+    Section* section = &ctx.sections[ctx.numSections++];
+
+    section->index = index;
+    section->addr = addr;
+    section->addrPhysical = TO_PHYSICAL(addr);
+    section->numWords = size / sizeof(u32);
+    section->bitmap = calloc((section->numWords + 63) / 64, sizeof(u64));
+
+    if (section->bitmap == NULL) {
+        printf("Coverage Failed to allocate bitmap\n");
+        exit(1);
+    }
+}
+
+void coverage_Mark(const u32 addr, const u32 numInstrs) {
+    for (int i = 0; i < ctx.numSections; i++) {
+        Section* section = &ctx.sections[i];
+
+        const u32 word = (addr - section->addrPhysical) / sizeof(u32);
+
+        if (word >= section->numWords) {
+            continue;
+        }
+
+        // Runs don't straddle sections, the interpreter stops at branches
+        const u32 end = (numInstrs > (section->numWords - word)) ? section->numWords : word + numInstrs;
+
+        for (u32 w = word; w < end; w++) {
+            section->bitmap[w / 64] |= (u64)1 << (w & 63);
+        }
+
+        return;
+    }
+}
+
+void coverage_WriteReport(const char* path) {
+    FILE* file = fopen(path, "w");
+
+    if (file == NULL) {
+        printf("Coverage Unable to open %s\n", path);
+        exit(1);
+    }
+
+    // One "TEXTn start end covered total" line per section, then its executed ranges as "start end"
+    for (int i = 0; i < ctx.numSections; i++) {
+        const Section* section = &ctx.sections[i];
+
+        const u32 numCovered = CountWords(section);
+
+        fprintf(file, "TEXT%d %08X %08X %u %u\n", section->index, section->addr, section->addr + (u32)sizeof(u32) * section->numWords, numCovered, section->numWords);
+
+        for (u32 word = 0; word < section->numWords;) {
+            if (!IsWordSet(section, word)) {
+                word++;
+
+                continue;
+            }
+
+            const u32 start = word;
+
+            while ((word < section->numWords) && IsWordSet(section, word)) {
+                word++;
+            }
+
+            fprintf(file, "%08X %08X\n", section->addr + (u32)sizeof(u32) * start, section->addr + (u32)sizeof(u32) * word);
+        }
+
+        printf("Coverage TEXT%d %6.2f%% (%u/%u words)\n", section->index, (section->numWords == 0) ? 0.0 : 100.0 * numCovered / section->numWords, numCovered, section->numWords);
+    }
+
+    fclose(file);
+
+    printf("Coverage Report written to %s\n", path);
+}
@@ -25,7 +25,7 @@ static u32 DvdLowGetCoverRegister(const u32 addr0, const u32 size0, const u32 ad
 
     printf("DI DvdLowGetCoverRegister (addr: %08X, size: %u)\n", addr1, size1);
 
-    memset(memory_GetPointer(addr1), 0, sizeof(u32));
+    memory_FillGuest(addr1, 0, sizeof(u32));
 
     return IOS_OK;
 }
@@ -46,7 +46,7 @@ static u32 GetDataDir(const u32 numIn, const u32 numOut, const u32 vec) {
 
     assert(titleId == TITLE_ID);
 
-    strncpy(memory_GetPointer(addrOut), "/title/00000001/00000002/data", sizeOut);
+    memory_CopyStringToGuest(addrOut, "/title/00000001/00000002/data", sizeOut);
 
     return IOS_OK;
 }
@@ -13,6 +13,10 @@
 #include "core/hle.h"
 #include "core/memory.h"
 
+// File attributes hold the file name after the owner ID and group ID
+#define OFFSET_NAME (6)
+#define SIZE_NAME   (0x40)
+
 enum {
     IOCTL_SET_ATTR = 5,
     IOCTL_GET_ATTR = 6,
@@ -24,7 +28,9 @@ static u32 SetAttr(const u32 addr0, const u32 size0, const u32 addr1, const u32
 
     assert(size0 == 0x4C);
 
-    const char* name = memory_GetPointer(addr0) + 6;
+    char name[SIZE_NAME + 1];
+
+    memory_CopyStringFromGuest(name, addr0 + OFFSET_NAME, sizeof(name));
 
     printf("FS SetAttr (name: %s)\n", name);
 
@@ -35,12 +41,14 @@ static u32 GetAttr(const u32 addr0, const u32 size0, const u32 addr1, const u32
     assert(size0 == 0x40);
     assert(size1 == 0x4C);
 
-    const char* name = memory_GetPointer(addr0);
+    char name[SIZE_NAME + 1];
+
+    memory_CopyStringFromGuest(name, addr0, sizeof(name));
 
     printf("FS GetAttr (name: %s, addr: %08X, size: %u)\n", name, addr1, size1);
 
-    memset(memory_GetPointer(addr1), 0, size1);
-    strncpy(memory_GetPointer(addr1) + 6, name, 0x40);
+    memory_FillGuest(addr1, 0, size1);
+    memory_CopyStringToGuest(addr1 + OFFSET_NAME, name, SIZE_NAME);
 
     return IOS_OK;
 }
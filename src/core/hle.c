@@ -6,17 +6,23 @@
 #include "core/hle.h"
 
 #include <assert.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "common/types.h"
 
 #include "core/dev_di.h"
 #include "core/es.h"
 #include "core/fs.h"
+#include "core/hostio.h"
+#include "core/instance.h"
 #include "core/memory.h"
+#include "core/replay.h"
 #include "core/scheduler.h"
+#include "core/stats.h"
 
 #include "hw/ipc.h"
 
@@ -25,8 +31,17 @@
 #define MAX_FILES     (128)
 #define MAX_FILE_NAME (129)
 
+// Each pending transfer holds a scheduler event, leave the rest to the hardware and other commands
+#define MAX_TRANSFERS (16)
+
+static_assert(2 * MAX_TRANSFERS <= SCHEDULER_MAX_EVENTS);
+
 #define NUM_TASK_CYCLES (128)
 
+// Guest-visible host I/O throughput, transfers finish after a fixed number of cycles
+// no matter how long the host takes, so runs stay deterministic
+#define NUM_BYTES_PER_CYCLE (4)
+
 enum {
     COMMAND_OPEN     = 1,
     COMMAND_CLOSE    = 2,
@@ -61,7 +76,11 @@ typedef struct File {
 
     char name[MAX_FILE_NAME];
 
-    FILE* data;
+    // Host file descriptor, -1 if there is none
+    int host;
+
+    // Kept here instead of the host, transfers use pread/pwrite on worker threads
+    u32 offset;
 
     u32 (*ioctl)(u32, u32, u32, u32, u32);
     u32 (*ioctlv)(u32, u32, u32, u32);
@@ -87,24 +106,41 @@ typedef union Packet {
 #define VEC     (packet.arg[3])
 #define SIZE1   (packet.arg[4])
 
+// Read or write handed to the host I/O workers, only holds guest state so it can be rewound
+typedef struct Transfer {
+    int pending;
+
+    u32 ppcmsg;
+
+    Packet packet;
+
+    u32 offset;
+
+    u64 ticket;
+} Transfer;
+
 typedef struct Context {
     int currentTask;
 
     int taskTimer;
-} Context;
 
-static Context ctx;
+    File files[MAX_FILES];
+
+    Transfer transfers[MAX_TRANSFERS];
 
-static File files[MAX_FILES];
+    i32 nextFd;
+} Context;
+
+#define ctx INSTANCE_CONTEXT(INSTANCE_HLE, Context)
 
 static i32 OpenFile(const char* path, const u32 mode) {
     (void)mode;
 
-    static i32 fd = 0;
+    const i32 fd = ctx.nextFd;
 
     assert(fd < MAX_FILES);
 
-    File* file = &files[fd];
+    File* file = &ctx.files[fd];
 
     assert(!file->opened);
 
@@ -118,6 +154,8 @@ static i32 OpenFile(const char* path, const u32 mode) {
         // TODO
     } else if (strncmp(path, "/dev/stm", strlen("/dev/stm")) == 0) {
         // TODO
+    } else if (replay_IsReplaying()) {
+        // Reads come from the replay log, host files are never touched
     } else {
         // Try and open as file
         char fpath[MAX_FILE_NAME];
@@ -125,25 +163,28 @@ static i32 OpenFile(const char* path, const u32 mode) {
         strncat(fpath, "filesystem", MAX_FILE_NAME);
         strncat(fpath, path, MAX_FILE_NAME);
 
-        file->data = fopen(fpath, "r+b");
+        file->host = open(fpath, O_RDWR);
 
-        if (file->data == NULL) {
+        if (file->host < 0) {
             printf("HLE Failed to open file %s\n", path);
             exit(1);
         }
     }
 
     file->opened = NOUWII_TRUE;
+    file->offset = 0;
 
     strncpy(file->name, path, MAX_FILE_NAME);
 
-    return fd++;
+    ctx.nextFd++;
+
+    return fd;
 }
 
 static u32 CloseFile(const i32 fd) {
     assert(fd < MAX_FILES);
 
-    File* file = &files[fd];
+    File* file = &ctx.files[fd];
 
     printf("HLE IPC_Close (fd: %d, name: %s)\n", fd, file->name);
 
@@ -156,53 +197,184 @@ static u32 CloseFile(const i32 fd) {
     return IOS_OK;
 }
 
-static u32 ReadFile(const i32 fd, const u32 addr, const u32 size) {
-    assert(fd < MAX_FILES);
+static void WriteResponse(const u32 ppcmsg, Packet* packet) {
+    packet->fd = packet->cmd;
+    packet->cmd = COMMAND_RESPONSE;
 
-    File* file = &files[fd];
+    for (u32 i = 0; i < sizeof(*packet); i += sizeof(u32)) {
+        printf("%08X ", packet->raw[i / sizeof(u32)]);
+    }
 
-    assert(file->opened);
-    assert(file->data != NULL);
+    // Packet is packed, copy through an aligned buffer
+    u32 raw[sizeof(*packet) / sizeof(u32)];
+
+    memcpy(raw, packet, sizeof(*packet));
+
+    memory_CopyToGuest32(ppcmsg, raw, sizeof(*packet) / sizeof(u32));
+
+    printf("\n");
+}
+
+static void FinishTransfer(const int idx) {
+    Transfer* transfer = &ctx.transfers[idx];
+
+    assert(transfer->pending);
 
-    printf("HLE IPC_Read (fd: %d, name: %s, addr: %08X, size: %u)\n", fd, file->name, addr, size);
+    const Packet* packet = &transfer->packet;
 
-    assert(fread(memory_GetPointer(addr), sizeof(u8), size, file->data) == size);
+    const int type = (packet->cmd == COMMAND_READ) ? HOSTIO_READ : HOSTIO_WRITE;
 
-    return size;
+    const int host = ctx.files[packet->fd].host;
+
+    const u32 addr = packet->arg[0];
+    const u32 size = packet->arg[1];
+
+    const stats_Scope scope = stats_Begin();
+
+    i64 result = size;
+
+    u8* buf = hostio_Complete(transfer->ticket, &result);
+
+    if (buf == NULL) {
+        // Never queued, or cancelled by a rewind
+        buf = malloc(size);
+
+        assert(buf != NULL);
+
+        if (type == HOSTIO_WRITE) {
+            memory_CopyFromGuest(buf, addr, size);
+        }
+
+        if (!replay_IsReplaying()) {
+            // Don't overtake what's still queued on this file
+            hostio_Wait(host);
+
+            result = hostio_Transfer(type, host, transfer->offset, buf, size);
+        }
+    }
+
+    stats_End(scope, "HLE I/O wait", 0);
+
+    assert(result == size);
+
+    if (type == HOSTIO_READ) {
+        // Host files may change between sessions
+        replay_Input(REPLAY_INPUT_FILE_READ, buf, size);
+
+        // The buffer may cross pages or contain code
+        memory_CopyToGuest(addr, buf, size);
+    }
+
+    free(buf);
+
+    transfer->packet.retval = size;
+
+    WriteResponse(transfer->ppcmsg, &transfer->packet);
+
+    transfer->pending = NOUWII_FALSE;
+
+    ipc_CommandCompleted(transfer->ppcmsg);
 }
 
-static u32 WriteFile(const i32 fd, const u32 addr, const u32 size) {
+// Returns false if too many transfers are pending, the command then fails with IOS_EQUEUEFULL
+static int StartTransfer(const u32 ppcmsg, const Packet* packet) {
+    const i32 fd = packet->fd;
+
     assert(fd < MAX_FILES);
 
-    File* file = &files[fd];
+    File* file = &ctx.files[fd];
 
     assert(file->opened);
-    assert(file->data != NULL);
+    assert((file->host >= 0) || replay_IsReplaying());
+
+    const u32 addr = packet->arg[0];
+    const u32 size = packet->arg[1];
 
-    printf("HLE IPC_Write (fd: %d, name: %s, addr: %08X, size: %u)\n", fd, file->name, addr, size);
+    printf("HLE %s (fd: %d, name: %s, addr: %08X, size: %u)\n", (packet->cmd == COMMAND_READ) ? "IPC_Read" : "IPC_Write", fd, file->name, addr, size);
 
-    assert(fwrite(memory_GetPointer(addr), sizeof(u8), size, file->data) == size);
+    int idx = 0;
 
-    return size;
+    while ((idx < MAX_TRANSFERS) && ctx.transfers[idx].pending) {
+        idx++;
+    }
+
+    if (idx == MAX_TRANSFERS) {
+        printf("HLE Too many pending transfers\n");
+
+        return NOUWII_FALSE;
+    }
+
+    Transfer* transfer = &ctx.transfers[idx];
+
+    transfer->pending = NOUWII_TRUE;
+    transfer->ppcmsg = ppcmsg;
+    transfer->packet = *packet;
+    transfer->offset = file->offset;
+    transfer->ticket = 0;
+
+    file->offset += size;
+
+    if (!replay_IsReplaying()) {
+        u8* buf = malloc(size);
+
+        assert(buf != NULL);
+
+        if (packet->cmd == COMMAND_WRITE) {
+            memory_CopyFromGuest(buf, addr, size);
+        }
+
+        transfer->ticket = hostio_Submit((packet->cmd == COMMAND_READ) ? HOSTIO_READ : HOSTIO_WRITE, file->host, transfer->offset, buf, size);
+    }
+
+    // Emulation carries on while the host does the I/O
+    scheduler_ScheduleEvent("hle_FinishTransfer", FinishTransfer, idx, NUM_TASK_CYCLES + size / NUM_BYTES_PER_CYCLE);
+
+    return NOUWII_TRUE;
 }
 
 static u32 SeekFile(const i32 fd, const u32 offset, const u32 origin) {
     assert(fd < MAX_FILES);
 
-    File* file = &files[fd];
+    File* file = &ctx.files[fd];
 
     assert(file->opened);
-    assert(file->data != NULL);
+    assert((file->host >= 0) || replay_IsReplaying());
 
     printf("HLE IPC_Seek (fd: %d, name: %s, offset: %u, origin: %u)\n", fd, file->name, offset, origin);
     
     assert(origin == 0);
 
-    fseek(file->data, offset, SEEK_SET);
+    file->offset = offset;
 
     return IOS_OK;
 }
 
+static void EndCommandScope(const stats_Scope scope, const Packet* packet) {
+    static const char* names[] = {
+        [COMMAND_OPEN]  = "HLE IPC_Open",
+        [COMMAND_CLOSE] = "HLE IPC_Close",
+        [COMMAND_READ]  = "HLE IPC_Read",
+        [COMMAND_WRITE] = "HLE IPC_Write",
+        [COMMAND_SEEK]  = "HLE IPC_Seek",
+    };
+
+    if (scope.start == 0) {
+        // Accounting is disabled, don't bother with the name
+        return;
+    }
+
+    if ((packet->cmd == COMMAND_IOCTL) || (packet->cmd == COMMAND_IOCTLV)) {
+        // Per device and ioctl
+        char name[MAX_FILE_NAME + 16];
+
+        snprintf(name, sizeof(name), "HLE %s %s", ctx.files[packet->fd].name, (packet->cmd == COMMAND_IOCTL) ? "ioctl" : "ioctlv");
+
+        stats_End(scope, name, packet->arg[0]);
+    } else {
+        stats_End(scope, names[packet->cmd], 0);
+    }
+}
+
 static void CompleteCommand(const int armmsg) {
     ipc_CommandCompleted(armmsg);
 }
@@ -210,18 +382,28 @@ static void CompleteCommand(const int armmsg) {
 static void ProcessCommand(const int ppcmsg) {
     Packet packet;
 
-    for (u32 i = 0; i < sizeof(packet); i += sizeof(u32)) {
-        packet.raw[i / sizeof(u32)] = memory_Read32(ppcmsg + i);
+    // Packet is packed, copy through an aligned buffer
+    u32 raw[sizeof(packet) / sizeof(u32)];
 
+    memory_CopyFromGuest32(raw, ppcmsg, sizeof(packet) / sizeof(u32));
+
+    memcpy(&packet, raw, sizeof(packet));
+
+    for (u32 i = 0; i < sizeof(packet); i += sizeof(u32)) {
         printf("%08X ", packet.raw[i / sizeof(u32)]);
     }
 
     printf("\n");
 
+    const stats_Scope scope = stats_Begin();
+
     switch (packet.cmd) {
         case COMMAND_OPEN:
             {
-                const char* name = (const char*)memory_GetPointer(packet.arg[0]);
+                char name[MAX_FILE_NAME];
+
+                memory_CopyStringFromGuest(name, packet.arg[0], sizeof(name));
+
                 const u32 mode = packet.arg[1];
 
                 printf("HLE IPC_Open (name: %s, mode: %u)\n", name, mode);
@@ -233,23 +415,29 @@ static void ProcessCommand(const int ppcmsg) {
             packet.retval = CloseFile(packet.fd);
             break;
         case COMMAND_READ:
-            packet.retval = ReadFile(packet.fd, packet.arg[0], packet.arg[1]);
-            break;
         case COMMAND_WRITE:
-            packet.retval = WriteFile(packet.fd, packet.arg[0], packet.arg[1]);
-            break;
+            if (!StartTransfer(ppcmsg, &packet)) {
+                packet.retval = IOS_EQUEUEFULL;
+                break;
+            }
+
+            EndCommandScope(scope, &packet);
+
+            // Responds once the transfer is finished
+            ipc_CommandAcknowledged();
+            return;
         case COMMAND_SEEK:
             packet.retval = SeekFile(packet.fd, packet.arg[0], packet.arg[1]);
             break;
         case COMMAND_IOCTL:
             printf("HLE IPC_Ioctl (fd: %u, ioctl: %08X)\n", packet.fd, packet.arg[0]);
 
-            packet.retval = files[packet.fd].ioctl(IOCTL, ADDR0, SIZE0, ADDR1, SIZE1);
+            packet.retval = ctx.files[packet.fd].ioctl(IOCTL, ADDR0, SIZE0, ADDR1, SIZE1);
             break;
         case COMMAND_IOCTLV:
             printf("HLE IPC_Ioctlv (fd: %u, ioctl: %08X, #in: %u, #out: %u)\n", packet.fd, IOCTL, NUM_IN, NUM_OUT);
 
-            packet.retval = files[packet.fd].ioctlv(IOCTL, NUM_IN, NUM_OUT, VEC);
+            packet.retval = ctx.files[packet.fd].ioctlv(IOCTL, NUM_IN, NUM_OUT, VEC);
             break;
         default:
             printf("HLE Unimplemented IPC command type %u\n", packet.cmd);
@@ -257,16 +445,9 @@ static void ProcessCommand(const int ppcmsg) {
             exit(1);
     }
 
-    packet.fd = packet.cmd;
-    packet.cmd = COMMAND_RESPONSE;
+    EndCommandScope(scope, &packet);
 
-    for (u32 i = 0; i < sizeof(packet); i += sizeof(u32)) {
-        printf("%08X ", packet.raw[i / sizeof(u32)]);
-
-        memory_Write32(ppcmsg + i, packet.raw[i / sizeof(u32)]);
-    }
-
-    printf("\n");
+    WriteResponse(ppcmsg, &packet);
 
     ipc_CommandAcknowledged();
 
@@ -274,15 +455,16 @@ static void ProcessCommand(const int ppcmsg) {
 }
 
 void hle_Initialize() {
-
+    instance_CreateContext(INSTANCE_HLE, sizeof(Context));
 }
 
 void hle_Reset() {
     memset(&ctx, 0, sizeof(ctx));
-    memset(files, 0, sizeof(files));
 
     for (int i = 0; i < MAX_FILES; i++) {
-        File* file = &files[i];
+        File* file = &ctx.files[i];
+
+        file->host = -1;
 
         file->ioctl = DummyIoctl;
         file->ioctlv = DummyIoctlv;
@@ -290,7 +472,15 @@ void hle_Reset() {
 }
 
 void hle_Shutdown() {
+    for (int i = 0; i < MAX_FILES; i++) {
+        File* file = &ctx.files[i];
+
+        if (file->host >= 0) {
+            close(file->host);
+        }
+    }
 
+    instance_DestroyContext(INSTANCE_HLE);
 }
 
 void hle_IpcExecute(const u32 ppcmsg) {
@@ -0,0 +1,361 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "core/hostio.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core/instance.h"
+
+#define NUM_WORKERS (4)
+
+// Must be a power of two, requests live in slot (ticket % MAX_REQUESTS)
+#define MAX_REQUESTS (64)
+
+typedef struct Request {
+    // 0 if the slot is free
+    u64 ticket;
+
+    int type;
+    int host;
+
+    u64 offset;
+
+    u8* buf;
+    u32 size;
+
+    int done;
+
+    // Nobody will claim it, the slot is freed once it's done
+    int cancelled;
+
+    i64 result;
+
+    // Slot + 1 of the next request on the same file, it's queued once this one is done
+    u32 next;
+} Request;
+
+typedef struct Context {
+    Request requests[MAX_REQUESTS];
+
+    u64 nextTicket;
+
+    // Slots waiting for a worker, at most one per file. The others wait in its chain
+    u32 queue[MAX_REQUESTS];
+
+    u32 head;
+    u32 tail;
+
+    // Protects everything above
+    pthread_mutex_t lock;
+
+    pthread_cond_t submitted;
+    pthread_cond_t finished;
+
+    pthread_t workers[NUM_WORKERS];
+
+    int running;
+} Context;
+
+#define ctx INSTANCE_CONTEXT(INSTANCE_HOSTIO, Context)
+
+static void* Worker(void* arg) {
+    // The worker serves the instance that started it
+    instance_MakeCurrent(arg);
+
+    pthread_mutex_lock(&ctx.lock);
+
+    while (NOUWII_TRUE) {
+        while (ctx.running && (ctx.head == ctx.tail)) {
+            pthread_cond_wait(&ctx.submitted, &ctx.lock);
+        }
+
+        if (!ctx.running) {
+            break;
+        }
+
+        Request* request = &ctx.requests[ctx.queue[ctx.head++ & (MAX_REQUESTS - 1)]];
+
+        pthread_mutex_unlock(&ctx.lock);
+
+        // Nobody else touches a queued request until it's done
+        const i64 result = hostio_Transfer(request->type, request->host, request->offset, request->buf, request->size);
+
+        pthread_mutex_lock(&ctx.lock);
+
+        request->result = result;
+        request->done = NOUWII_TRUE;
+
+        if (request->next != 0) {
+            // Only now may the next request on this file start, so they can't overtake each other
+            ctx.queue[ctx.tail++ & (MAX_REQUESTS - 1)] = request->next - 1;
+
+            request->next = 0;
+
+            pthread_cond_signal(&ctx.submitted);
+        }
+
+        if (request->cancelled) {
+            free(request->buf);
+
+            memset(request, 0, sizeof(Request));
+        }
+
+        pthread_cond_broadcast(&ctx.finished);
+    }
+
+    pthread_mutex_unlock(&ctx.lock);
+
+    return NULL;
+}
+
+static void StartWorkers() {
+    ctx.running = NOUWII_TRUE;
+
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        if (pthread_create(&ctx.workers[i], NULL, Worker, instance_current) != 0) {
+            printf("Host I/O Failed to create worker thread\n");
+            exit(1);
+        }
+    }
+}
+
+static void StopWorkers() {
+    if (!ctx.running) {
+        return;
+    }
+
+    // Workers finish the request they are on, the rest stay queued
+    pthread_mutex_lock(&ctx.lock);
+
+    ctx.running = NOUWII_FALSE;
+
+    pthread_cond_broadcast(&ctx.submitted);
+    pthread_mutex_unlock(&ctx.lock);
+
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        pthread_join(ctx.workers[i], NULL);
+    }
+}
+
+// Returns the last unfinished request on a host file, NULL if there is none
+static Request* FindLastRequest(const int host) {
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        Request* request = &ctx.requests[i];
+
+        if ((request->ticket != 0) && !request->done && (request->host == host) && (request->next == 0)) {
+            return request;
+        }
+    }
+
+    return NULL;
+}
+
+static int IsIdle() {
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        const Request* request = &ctx.requests[i];
+
+        if ((request->ticket != 0) && !request->done) {
+            return NOUWII_FALSE;
+        }
+    }
+
+    return NOUWII_TRUE;
+}
+
+static void FreeRequests() {
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        free(ctx.requests[i].buf);
+    }
+
+    memset(ctx.requests, 0, sizeof(ctx.requests));
+
+    ctx.head = 0;
+    ctx.tail = 0;
+}
+
+void hostio_Initialize() {
+    instance_CreateContext(INSTANCE_HOSTIO, sizeof(Context));
+
+    // Tickets are never reused, not even across resets
+    ctx.nextTicket = 1;
+
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.submitted, NULL);
+    pthread_cond_init(&ctx.finished, NULL);
+}
+
+void hostio_Reset() {
+    StopWorkers();
+    FreeRequests();
+    StartWorkers();
+}
+
+void hostio_Shutdown() {
+    StopWorkers();
+    FreeRequests();
+
+    pthread_mutex_destroy(&ctx.lock);
+    pthread_cond_destroy(&ctx.submitted);
+    pthread_cond_destroy(&ctx.finished);
+
+    instance_DestroyContext(INSTANCE_HOSTIO);
+}
+
+void hostio_Suspend() {
+    pthread_mutex_lock(&ctx.lock);
+
+    // A forked child would run whatever is left a second time
+    while (ctx.running && !IsIdle()) {
+        pthread_cond_wait(&ctx.finished, &ctx.lock);
+    }
+
+    pthread_mutex_unlock(&ctx.lock);
+
+    StopWorkers();
+}
+
+void hostio_Resume() {
+    StartWorkers();
+}
+
+u64 hostio_Submit(const int type, const int host, const u64 offset, u8* buf, const u32 size) {
+    pthread_mutex_lock(&ctx.lock);
+
+    const u64 ticket = ctx.nextTicket;
+
+    const u32 slot = ticket & (MAX_REQUESTS - 1);
+
+    Request* request = &ctx.requests[slot];
+
+    if (request->ticket != 0) {
+        // Still running, or finished and not claimed yet. Its result must stay until the owner comes for it,
+        // skip the ticket so only requests landing on this slot fail
+        ctx.nextTicket++;
+
+        pthread_mutex_unlock(&ctx.lock);
+
+        free(buf);
+
+        return 0;
+    }
+
+    Request* last = FindLastRequest(host);
+
+    ctx.nextTicket++;
+
+    request->ticket = ticket;
+    request->type = type;
+    request->host = host;
+    request->offset = offset;
+    request->buf = buf;
+    request->size = size;
+    request->done = NOUWII_FALSE;
+    request->cancelled = NOUWII_FALSE;
+    request->next = 0;
+
+    if (last != NULL) {
+        // Runs after the file's previous request, like the guest issued them
+        last->next = slot + 1;
+    } else {
+        ctx.queue[ctx.tail++ & (MAX_REQUESTS - 1)] = slot;
+
+        pthread_cond_signal(&ctx.submitted);
+    }
+
+    pthread_mutex_unlock(&ctx.lock);
+
+    return ticket;
+}
+
+void hostio_Wait(const int host) {
+    pthread_mutex_lock(&ctx.lock);
+
+    while (FindLastRequest(host) != NULL) {
+        pthread_cond_wait(&ctx.finished, &ctx.lock);
+    }
+
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+u8* hostio_Complete(const u64 ticket, i64* result) {
+    if (ticket == 0) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&ctx.lock);
+
+    Request* request = &ctx.requests[ticket & (MAX_REQUESTS - 1)];
+
+    if ((request->ticket != ticket) || request->cancelled) {
+        pthread_mutex_unlock(&ctx.lock);
+
+        return NULL;
+    }
+
+    while (!request->done) {
+        pthread_cond_wait(&ctx.finished, &ctx.lock);
+    }
+
+    u8* buf = request->buf;
+
+    *result = request->result;
+
+    request->ticket = 0;
+    request->buf = NULL;
+
+    pthread_mutex_unlock(&ctx.lock);
+
+    return buf;
+}
+
+void hostio_CancelAll() {
+    pthread_mutex_lock(&ctx.lock);
+
+    for (int i = 0; i < MAX_REQUESTS; i++) {
+        Request* request = &ctx.requests[i];
+
+        if (request->ticket == 0) {
+            continue;
+        }
+
+        if (request->done) {
+            free(request->buf);
+
+            memset(request, 0, sizeof(Request));
+        } else {
+            // Queued requests still run, later requests on the same file are chained behind them
+            request->cancelled = NOUWII_TRUE;
+        }
+    }
+
+    pthread_mutex_unlock(&ctx.lock);
+}
+
+i64 hostio_Transfer(const int type, const int host, const u64 offset, u8* buf, const u32 size) {
+    u32 total = 0;
+
+    while (total < size) {
+        const ssize_t n = (type == HOSTIO_READ) ? pread(host, &buf[total], size - total, offset + total) : pwrite(host, &buf[total], size - total, offset + total);
+
+        if (n < 0) {
+            return -1;
+        }
+
+        if (n == 0) {
+            // End of file
+            break;
+        }
+
+        total += n;
+    }
+
+    return total;
+}
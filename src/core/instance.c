@@ -0,0 +1,85 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "core/instance.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Thread_local nouwii_Instance* instance_current = NULL;
+
+_Thread_local void* instance_contexts[INSTANCE_NUM_MODULES];
+
+nouwii_Instance* instance_Create() {
+    nouwii_Instance* instance = calloc(1, sizeof(*instance));
+
+    if (instance == NULL) {
+        printf("Instance Failed to allocate instance\n");
+        exit(1);
+    }
+
+    return instance;
+}
+
+void instance_Destroy(nouwii_Instance* instance) {
+    for (int module = 0; module < INSTANCE_NUM_MODULES; module++) {
+        // All modules must be shut down first
+        assert(instance->contexts[module] == NULL);
+    }
+
+    if (instance_current == instance) {
+        instance_MakeCurrent(NULL);
+    }
+
+    free(instance);
+}
+
+void instance_MakeCurrent(nouwii_Instance* instance) {
+    instance_current = instance;
+
+    if (instance != NULL) {
+        memcpy(instance_contexts, instance->contexts, sizeof(instance_contexts));
+    } else {
+        memset(instance_contexts, 0, sizeof(instance_contexts));
+    }
+}
+
+void instance_CreateContext(const int module, const usize size) {
+    assert(instance_current != NULL);
+    assert(instance_current->contexts[module] == NULL);
+
+    void* context = calloc(1, size);
+
+    if (context == NULL) {
+        printf("Instance Failed to allocate context for module %d\n", module);
+        exit(1);
+    }
+
+    instance_current->contexts[module] = context;
+    instance_current->sizes[module] = size;
+
+    instance_contexts[module] = context;
+}
+
+void instance_DestroyContext(const int module) {
+    assert(instance_current != NULL);
+
+    free(instance_current->contexts[module]);
+
+    instance_current->contexts[module] = NULL;
+    instance_current->sizes[module] = 0;
+
+    instance_contexts[module] = NULL;
+}
+
+void* instance_GetContext(const int module, usize* size) {
+    assert(instance_current != NULL);
+
+    *size = instance_current->sizes[module];
+
+    return instance_current->contexts[module];
+}
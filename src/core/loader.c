@@ -13,25 +13,51 @@
 #include "common/buffer.h"
 #include "common/file.h"
 
+#include "core/coverage.h"
+#include "core/instance.h"
 #include "core/memory.h"
+#include "core/stats.h"
 
 #define MAX_TEXT (7)
 #define MAX_DATA (11)
 
-static const char* pathDol;
+typedef struct Context {
+    const char* pathDol;
 
-static u8* dol = NULL;
+    u8* dol;
 
-static u32 entry;
+    u32 entry;
+} Context;
+
+#define ctx INSTANCE_CONTEXT(INSTANCE_LOADER, Context)
+
+void loader_Initialize() {
+    instance_CreateContext(INSTANCE_LOADER, sizeof(Context));
+}
+
+void loader_Shutdown() {
+    free(ctx.dol);
+
+    instance_DestroyContext(INSTANCE_LOADER);
+}
 
 void loader_SetDolPath(const char *path) {
-    pathDol = path;
+    ctx.pathDol = path;
 }
 
 void loader_LoadDol() {
-    printf("Loading DOL %s\n", pathDol);
+    printf("Loading DOL %s\n", ctx.pathDol);
 
-    const long size = common_LoadFile(pathDol, (void**)&dol);
+    // Reloaded on every reset
+    free(ctx.dol);
+
+    const stats_Scope scope = stats_Begin();
+
+    const long size = common_LoadFile(ctx.pathDol, (void**)&ctx.dol);
+
+    stats_End(scope, "Loader I/O", 0);
+
+    const u8* dol = ctx.dol;
 
     assert(size > 0);
 
@@ -53,7 +79,11 @@ void loader_LoadDol() {
 
         printf("size: %u, offset: %08X, addr: %08X\n", sizeSection, offset, addr);
 
-        memcpy(memory_GetPointer(TO_PHYSICAL(addr)), &dol[offset], sizeSection);
+        memory_CopyToGuest(TO_PHYSICAL(addr), &dol[offset], sizeSection);
+
+        if (i < MAX_TEXT) {
+            coverage_AddSection(i, addr, sizeSection);
+        }
     }
     
     const u32 addrBss = GET32(dol, size, 0xD8);
@@ -61,13 +91,13 @@ void loader_LoadDol() {
 
     printf("Clearing BSS (address: %08X, size: %u)\n", addrBss, sizeBss);
 
-    memset(memory_GetPointer(TO_PHYSICAL(addrBss)), 0, sizeBss);
+    memory_FillGuest(TO_PHYSICAL(addrBss), 0, sizeBss);
 
-    entry = GET32(dol, size, 0xE0);
+    ctx.entry = GET32(dol, size, 0xE0);
 
-    printf("Entry: %08X\n", entry);
+    printf("Entry: %08X\n", ctx.entry);
 }
 
 u32 loader_GetEntry() {
-    return TO_PHYSICAL(entry);
+    return TO_PHYSICAL(ctx.entry);
 }
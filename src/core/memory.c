@@ -6,13 +6,19 @@
 #include "core/memory.h"
 
 #include <assert.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "common/bswap.h"
 #include "common/buffer.h"
 
+#include "core/codecache.h"
+#include "core/instance.h"
+#include "core/stats.h"
+
 #include "hw/ai.h"
 #include "hw/di.h"
 #include "hw/dsp.h"
@@ -25,7 +31,12 @@
 
 #define SIZE_ADDRESS_SPACE (0x100000000)
 #define SIZE_PAGE (0x1000)
-#define SIZE_PAGE_TABLE (SIZE_ADDRESS_SPACE / SIZE_PAGE)
+#define SIZE_HUGE_PAGE (0x200000)
+
+// Each second level table covers 4 MiB, only tables with mapped pages are allocated
+#define SIZE_LEAF (0x400000)
+#define NUM_LEAVES (SIZE_ADDRESS_SPACE / SIZE_LEAF)
+#define NUM_LEAF_PAGES (SIZE_LEAF / SIZE_PAGE)
 
 enum {
     BASE_MEM1 = 0x00000000,
@@ -55,18 +66,52 @@ enum {
     SIZE_MEM2 = 0x4000000,
 };
 
+#define NUM_MEM1_PAGES (SIZE_MEM1 / SIZE_PAGE)
+
+static_assert(MEMORY_NUM_RAM_PAGES == ((SIZE_MEM1 + SIZE_MEM2) / SIZE_PAGE));
+
+enum {
+    PAGE_CODE  = 1 << 0, // Compiled by the code cache, writes invalidate the page
+    PAGE_CLEAN = 1 << 1, // Not written to since the dirty bitmap was collected
+
+    PAGE_WATCH_READ  = 1 << 2,
+    PAGE_WATCH_WRITE = 1 << 3,
+};
+
+// Writes to RAM pages with any of these flags take the slow path
+#define PAGE_TRAP_WRITE (PAGE_CODE | PAGE_CLEAN | PAGE_WATCH_WRITE)
+
+#define MAX_WATCHPOINTS (16)
+
 #define MAKEFUNC_READ(size)                                           \
 u##size memory_Read##size(const u32 addr) {                           \
-    const u32 page = addr / SIZE_PAGE;                                \
+    const u8* mem = GetLeaf(addr)->rd[GetLeafPage(addr)];             \
     const u32 offset = addr & (SIZE_PAGE - 1);                        \
                                                                       \
-    if (ctx.tableRd[page] != NULL) {                                  \
+    if (mem != NULL) {                                                \
         u##size data;                                                 \
-        memcpy(&data, &ctx.tableRd[page][offset], sizeof(u##size));   \
+        memcpy(&data, &mem[offset], sizeof(u##size));                 \
         return common_Bswap##size(data);                              \
     }                                                                 \
                                                                       \
-    return ReadIo##size(addr);                                        \
+    mem = TrapRead(addr);                                             \
+                                                                      \
+    if (mem != NULL) {                                                \
+        u##size data;                                                 \
+        memcpy(&data, &mem[offset], sizeof(u##size));                 \
+        data = common_Bswap##size(data);                              \
+        CheckWatchpoints(addr, sizeof(u##size), data, NOUWII_FALSE);  \
+        return data;                                                  \
+    }                                                                 \
+                                                                      \
+    ctx.ioDepth++;                                                    \
+    ctx.numIoAccesses++;                                              \
+    const stats_Scope scope = stats_Begin();                          \
+    const u##size data = ReadIo##size(addr);                          \
+    stats_End(scope, GetIoName(addr), 0);                             \
+    ctx.ioDepth--;                                                    \
+                                                                      \
+    return data;                                                      \
 }                                                                     \
 
 #define MAKEFUNC_READIO(size)                                \
@@ -108,21 +153,44 @@ u##size ReadIo##size(const u32 addr) {                       \
     }                                                        \
                                                              \
     printf("Unmapped read%d (address: %08X)\n", size, addr); \
-    exit(1);                                                 \
+    Fault(addr, NOUWII_FALSE);                               \
 }                                                            \
 
 #define MAKEFUNC_WRITE(size)                                                    \
 void memory_Write##size(const u32 addr, const u##size data) {                   \
-    const u32 page = addr / SIZE_PAGE;                                          \
+    u8* mem = GetLeaf(addr)->wr[GetLeafPage(addr)];                             \
     const u32 offset = addr & (SIZE_PAGE - 1);                                  \
                                                                                 \
-    if (ctx.tableWr[page] != NULL) {                                            \
+    if (mem != NULL) {                                                          \
+        const u##size bswapData = common_Bswap##size(data);                     \
+        memcpy(&mem[offset], &bswapData, sizeof(u##size));                      \
+        return;                                                                 \
+    }                                                                           \
+                                                                                \
+    const u8 trap = TrapWrite(addr);                                            \
+                                                                                \
+    if (trap != 0) {                                                            \
         const u##size bswapData = common_Bswap##size(data);                     \
-        memcpy(&ctx.tableWr[page][offset], &bswapData, sizeof(u##size));        \
+        mem = GetLeaf(addr)->host[GetLeafPage(addr)];                           \
+        memcpy(&mem[offset], &bswapData, sizeof(u##size));                      \
+                                                                                \
+        if ((trap & PAGE_CODE) != 0) {                                          \
+            InvalidateCode(addr);                                               \
+        }                                                                       \
+                                                                                \
+        if ((trap & PAGE_WATCH_WRITE) != 0) {                                   \
+            CheckWatchpoints(addr, sizeof(u##size), data, NOUWII_TRUE);         \
+        }                                                                       \
+                                                                                \
         return;                                                                 \
     }                                                                           \
                                                                                 \
+    ctx.ioDepth++;                                                              \
+    ctx.numIoAccesses++;                                                        \
+    const stats_Scope scope = stats_Begin();                                    \
     WriteIo##size(addr, data);                                                  \
+    stats_End(scope, GetIoName(addr), 0);                                       \
+    ctx.ioDepth--;                                                              \
 }                                                                               \
 
 #define MAKEFUNC_WRITEIO(size)                                                  \
@@ -173,45 +241,364 @@ void WriteIo##size(const u32 addr, const u##size data) {
     }                                                                           \
                                                                                 \
     printf("Unmapped write%d (address: %08X, data: %02X)\n", size, addr, data); \
-    exit(1);                                                                    \
+    Fault(addr, NOUWII_TRUE);                                                   \
 }                                                                               \
 
+typedef struct Leaf {
+    // Host pages, NULL if the access goes through the slow path
+    u8* rd[NUM_LEAF_PAGES];
+    u8* wr[NUM_LEAF_PAGES];
+
+    // Host pages, even if accesses are trapped
+    u8* host[NUM_LEAF_PAGES];
+
+    _Atomic(u8) flags[NUM_LEAF_PAGES];
+} Leaf;
+
+typedef struct Watchpoint {
+    u32 addr;
+    u32 size;
+
+    int type;
+} Watchpoint;
+
 typedef struct Context {
-    u8** tableRd;
-    u8** tableWr;
+    // Unused entries point to emptyLeaf, lookups never check for NULL
+    Leaf* leaves[NUM_LEAVES];
 
     u8* mem1;
     u8* mem2;
+
+    // RAM pages written to since the last collection of any tracker
+    u64 dirty[MEMORY_SIZE_DIRTY_BITMAP];
+
+    // Pages not collected by each tracker yet
+    u64 trackers[MEMORY_NUM_DIRTY_TRACKERS][MEMORY_SIZE_DIRTY_BITMAP];
+
+    int isTrackingDirty;
+
+    memory_FaultHandler faultHandler;
+
+    Watchpoint watchpoints[MAX_WATCHPOINTS];
+
+    int numWatchpoints;
+
+    memory_WatchHandler watchHandler;
+
+    // Nesting of I/O accesses, device emulation can access memory too
+    int ioDepth;
+
+    u64 numIoAccesses;
 } Context;
 
-static Context ctx;
+#define ctx INSTANCE_CONTEXT(INSTANCE_MEMORY, Context)
+
+// Shared by all instances, never written to
+static Leaf emptyLeaf;
+
+static Leaf* GetLeaf(const u32 addr) {
+    return ctx.leaves[addr / SIZE_LEAF];
+}
+
+static u32 GetLeafPage(const u32 addr) {
+    return (addr / SIZE_PAGE) & (NUM_LEAF_PAGES - 1);
+}
+
+static Leaf* AllocateLeaf(const u32 addr) {
+    Leaf** leaf = &ctx.leaves[addr / SIZE_LEAF];
+
+    if (*leaf == &emptyLeaf) {
+        *leaf = calloc(1, sizeof(Leaf));
+
+        if (*leaf == NULL) {
+            printf("Memory Failed to allocate page table\n");
+            exit(1);
+        }
+    }
+
+    return *leaf;
+}
+
+static u8* AllocateRam(const usize size) {
+    // Transparent huge pages rather than MAP_HUGETLB. Forked instances share RAM copy-on-write,
+    // and a write to a hugetlb page would copy all of it, or SIGBUS if the host's pool is empty.
+    // Align to a huge page so they can back all of it
+    u8* raw = mmap(NULL, size + SIZE_HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (raw == MAP_FAILED) {
+        printf("Memory Failed to allocate %zu bytes of RAM\n", size);
+        exit(1);
+    }
+
+    const usize head = (SIZE_HUGE_PAGE - ((uintptr_t)raw & (SIZE_HUGE_PAGE - 1))) & (SIZE_HUGE_PAGE - 1);
+
+    if (head != 0) {
+        munmap(raw, head);
+    }
+
+    munmap(&raw[head + size], SIZE_HUGE_PAGE - head);
+
+    madvise(&raw[head], size, MADV_HUGEPAGE);
+
+    return &raw[head];
+}
+
+static void ClearRam(u8* mem, const usize size) {
+    // Drops the pages, they read as zero on the next access
+    if (madvise(mem, size, MADV_DONTNEED) != 0) {
+        memset(mem, 0, size);
+    }
+}
+
+static _Noreturn void Fault(const u32 addr, const int write) {
+    // Only the outermost access can be restarted, devices handling I/O can't
+    if ((ctx.faultHandler != NULL) && (ctx.ioDepth == 1)) {
+        // The handler doesn't return
+        ctx.ioDepth = 0;
+
+        ctx.faultHandler(addr, write);
+    }
+
+    exit(1);
+}
+
+// Device names for time accounting, same decoding as ReadIo/WriteIo
+static const char* GetIoName(const u32 addr) {
+    if ((addr & ~(SIZE_VI - 1)) == BASE_VI) {
+        return "MMIO VI";
+    }
+
+    if ((addr & ~(SIZE_PI - 1)) == BASE_PI) {
+        return "MMIO PI";
+    }
+
+    if ((addr & ~(SIZE_MI - 1)) == BASE_MI) {
+        return "MMIO MI";
+    }
+
+    if ((addr & ~(SIZE_DSP - 1)) == BASE_DSP) {
+        return "MMIO DSP";
+    }
+
+    if ((addr & ~((SIZE_HW - 1) | (1 << 23))) == BASE_HW) {
+        return "MMIO Hollywood";
+    }
+
+    if ((addr & ~(SIZE_DI - 1)) == BASE_DI) {
+        return "MMIO DI";
+    }
+
+    if ((addr & ~(SIZE_SI - 1)) == BASE_SI) {
+        return "MMIO SI";
+    }
+
+    if ((addr & ~(SIZE_EXI - 1)) == BASE_EXI) {
+        return "MMIO EXI";
+    }
+
+    if ((addr & ~(SIZE_AI - 1)) == BASE_AI) {
+        return "MMIO AI";
+    }
+
+    return "MMIO unmapped";
+}
+
+static u32 GetRamPage(const u32 addr) {
+    if ((addr - BASE_MEM1) < SIZE_MEM1) {
+        return (addr - BASE_MEM1) / SIZE_PAGE;
+    }
+
+    assert((addr - BASE_MEM2) < SIZE_MEM2);
+
+    return NUM_MEM1_PAGES + (addr - BASE_MEM2) / SIZE_PAGE;
+}
+
+static void UpdateFastPath(Leaf* leaf, const u32 page) {
+    const u8 flags = atomic_load_explicit(&leaf->flags[page], memory_order_relaxed);
+
+    leaf->rd[page] = ((flags & PAGE_WATCH_READ) != 0) ? NULL : leaf->host[page];
+    leaf->wr[page] = ((flags & PAGE_TRAP_WRITE) != 0) ? NULL : leaf->host[page];
+}
+
+// Handles a write to a RAM page on the slow path, returns the flags that trapped it
+static u8 TrapWrite(const u32 addr) {
+    Leaf* leaf = GetLeaf(addr);
+
+    const u32 page = GetLeafPage(addr);
+
+    const u8 flags = atomic_load_explicit(&leaf->flags[page], memory_order_relaxed) & PAGE_TRAP_WRITE;
+
+    if (flags == 0) {
+        return 0;
+    }
+
+    if ((flags & PAGE_CLEAN) != 0) {
+        atomic_fetch_and(&leaf->flags[page], (u8)~PAGE_CLEAN);
+
+        const u32 ramPage = GetRamPage(addr);
+
+        ctx.dirty[ramPage / 64] |= (u64)1 << (ramPage & 63);
+    }
+
+    // Code pages get their fast path back once invalidated
+    UpdateFastPath(leaf, page);
+
+    return flags;
+}
+
+// Returns the host page if reads of it are trapped by a watchpoint
+static u8* TrapRead(const u32 addr) {
+    Leaf* leaf = GetLeaf(addr);
+
+    const u32 page = GetLeafPage(addr);
+
+    if ((atomic_load_explicit(&leaf->flags[page], memory_order_relaxed) & PAGE_WATCH_READ) == 0) {
+        return NULL;
+    }
+
+    return leaf->host[page];
+}
+
+static void CheckWatchpoints(const u32 addr, const u32 size, const u64 data, const int write) {
+    for (int i = 0; i < ctx.numWatchpoints; i++) {
+        const Watchpoint* watchpoint = &ctx.watchpoints[i];
+
+        if ((watchpoint->type & ((write) ? MEMORY_WATCH_WRITE : MEMORY_WATCH_READ)) == 0) {
+            continue;
+        }
+
+        if (((addr + size) <= watchpoint->addr) || (addr >= (watchpoint->addr + watchpoint->size))) {
+            continue;
+        }
+
+        if (ctx.watchHandler != NULL) {
+            ctx.watchHandler(addr, size, data, write);
+        } else {
+            printf("Memory Watchpoint hit (address: %08X, %s%u, data: %llX)\n", addr, (write) ? "write" : "read", 8 * size, (unsigned long long)data);
+        }
+
+        return;
+    }
+}
+
+static void InvalidateCode(const u32 addr) {
+    Leaf* leaf = GetLeaf(addr);
+
+    const u32 page = GetLeafPage(addr);
+
+    // Must happen after the write so the code cache never compiles stale code with a new generation
+    atomic_fetch_and(&leaf->flags[page], (u8)~PAGE_CODE);
+
+    UpdateFastPath(leaf, page);
+
+    codecache_Invalidate(addr & ~(SIZE_PAGE - 1), SIZE_PAGE);
+}
+
+// Bulk accesses are split so that no chunk crosses a page
+static u32 GetChunkSize(const u32 addr, const u32 size) {
+    const u32 sizeLeft = SIZE_PAGE - (addr & (SIZE_PAGE - 1));
+
+    return (size < sizeLeft) ? size : sizeLeft;
+}
+
+// Returns the host memory of a chunk about to be written, NULL if it isn't RAM
+static u8* BeginWrite(const u32 addr, u8* trap) {
+    u8* mem = GetLeaf(addr)->wr[GetLeafPage(addr)];
+
+    *trap = 0;
+
+    if (mem == NULL) {
+        *trap = TrapWrite(addr);
+
+        if (*trap == 0) {
+            return NULL;
+        }
+
+        mem = GetLeaf(addr)->host[GetLeafPage(addr)];
+    }
+
+    return &mem[addr & (SIZE_PAGE - 1)];
+}
+
+static void EndWrite(const u32 addr, const u32 size, const u8 trap) {
+    if ((trap & PAGE_CODE) != 0) {
+        InvalidateCode(addr);
+    }
+
+    if ((trap & PAGE_WATCH_WRITE) != 0) {
+        CheckWatchpoints(addr, size, 0, NOUWII_TRUE);
+    }
+}
+
+// Returns the host memory of a chunk about to be read, NULL if it isn't RAM
+static const u8* BeginRead(const u32 addr, int* isWatched) {
+    const u8* mem = GetLeaf(addr)->rd[GetLeafPage(addr)];
+
+    *isWatched = NOUWII_FALSE;
+
+    if (mem == NULL) {
+        mem = TrapRead(addr);
+
+        if (mem == NULL) {
+            return NULL;
+        }
+
+        *isWatched = NOUWII_TRUE;
+    }
+
+    return &mem[addr & (SIZE_PAGE - 1)];
+}
+
+static void EndRead(const u32 addr, const u32 size, const int isWatched) {
+    if (isWatched) {
+        CheckWatchpoints(addr, size, 0, NOUWII_FALSE);
+    }
+}
 
 void memory_Initialize() {
-    memset(&ctx, 0, sizeof(ctx));
+    instance_CreateContext(INSTANCE_MEMORY, sizeof(Context));
 
-    ctx.tableRd = malloc(SIZE_PAGE_TABLE * sizeof(usize));
-    ctx.tableWr = malloc(SIZE_PAGE_TABLE * sizeof(usize));
+    for (u32 leaf = 0; leaf < NUM_LEAVES; leaf++) {
+        ctx.leaves[leaf] = &emptyLeaf;
+    }
 
-    ctx.mem1 = malloc(SIZE_MEM1);
-    ctx.mem2 = malloc(SIZE_MEM2);
+    ctx.mem1 = AllocateRam(SIZE_MEM1);
+    ctx.mem2 = AllocateRam(SIZE_MEM2);
 }
 
 void memory_Reset() {
-    memset(ctx.tableRd, 0, SIZE_PAGE_TABLE * sizeof(usize));
-    memset(ctx.tableWr, 0, SIZE_PAGE_TABLE * sizeof(usize));
+    for (u32 leaf = 0; leaf < NUM_LEAVES; leaf++) {
+        if (ctx.leaves[leaf] != &emptyLeaf) {
+            // Kept around, the code cache worker may still be looking at it
+            memset(ctx.leaves[leaf], 0, sizeof(Leaf));
+        }
+    }
+
+    memset(ctx.dirty, 0, sizeof(ctx.dirty));
+    memset(ctx.trackers, 0, sizeof(ctx.trackers));
+
+    ctx.isTrackingDirty = NOUWII_FALSE;
 
-    memset(ctx.mem1, 0, SIZE_MEM1);
-    memset(ctx.mem2, 0, SIZE_MEM2);
+    ctx.numWatchpoints = 0;
+
+    ClearRam(ctx.mem1, SIZE_MEM1);
+    ClearRam(ctx.mem2, SIZE_MEM2);
 
     memory_Map(ctx.mem1, BASE_MEM1, SIZE_MEM1, NOUWII_TRUE, NOUWII_TRUE);
     memory_Map(ctx.mem2, BASE_MEM2, SIZE_MEM2, NOUWII_TRUE, NOUWII_TRUE);
 }
 
 void memory_Shutdown() {
-    free(ctx.tableRd);
-    free(ctx.tableWr);
-    free(ctx.mem1);
-    free(ctx.mem2);
+    for (u32 leaf = 0; leaf < NUM_LEAVES; leaf++) {
+        if (ctx.leaves[leaf] != &emptyLeaf) {
+            free(ctx.leaves[leaf]);
+        }
+    }
+
+    munmap(ctx.mem1, SIZE_MEM1);
+    munmap(ctx.mem2, SIZE_MEM2);
+
+    instance_DestroyContext(INSTANCE_MEMORY);
 }
 
 MAKEFUNC_READIO(8)
@@ -238,39 +625,388 @@ void memory_Map(u8* mem, const u32 addr, const u32 size, const int read, const i
     assert(common_IsAligned(addr, SIZE_PAGE));
     assert(common_IsAligned(size, SIZE_PAGE));
 
-    const u32 firstPage = addr / SIZE_PAGE;
     const u32 numPages = size / SIZE_PAGE;
 
     printf("Mapping %X pages to %08X (%s/%s)\n", numPages, addr, (read) ? "R" : "-", (write) ? "W" : "-");
 
-    for (u32 page = firstPage; page < (firstPage + numPages); page++) {
-        const u32 memIdx = page - firstPage;
+    for (u32 memIdx = 0; memIdx < numPages; memIdx++) {
+        const u32 pageAddr = addr + SIZE_PAGE * memIdx;
 
-        if (read) {
-            assert(ctx.tableRd[page] == NULL);
+        Leaf* leaf = AllocateLeaf(pageAddr);
+
+        const u32 page = GetLeafPage(pageAddr);
+
+        assert(leaf->host[page] == NULL);
 
-            ctx.tableRd[page] = &mem[SIZE_PAGE * memIdx];
+        leaf->host[page] = &mem[SIZE_PAGE * memIdx];
+
+        if (read) {
+            leaf->rd[page] = &mem[SIZE_PAGE * memIdx];
         }
 
         if (write) {
-            assert(ctx.tableWr[page] == NULL);
+            leaf->wr[page] = &mem[SIZE_PAGE * memIdx];
+        }
+    }
+}
 
-            ctx.tableWr[page] = &mem[SIZE_PAGE * memIdx];
+void memory_Unmap(const u32 addr, const u32 size) {
+    assert(common_IsAligned(addr, SIZE_PAGE));
+    assert(common_IsAligned(size, SIZE_PAGE));
+
+    const u32 numPages = size / SIZE_PAGE;
+
+    printf("Unmapping %X pages from %08X\n", numPages, addr);
+
+    for (u32 memIdx = 0; memIdx < numPages; memIdx++) {
+        const u32 pageAddr = addr + SIZE_PAGE * memIdx;
+
+        Leaf* leaf = GetLeaf(pageAddr);
+
+        if (leaf == &emptyLeaf) {
+            continue;
         }
+
+        const u32 page = GetLeafPage(pageAddr);
+
+        // Dirty tracking only covers RAM, which is never unmapped
+        if ((atomic_exchange(&leaf->flags[page], 0) & PAGE_CODE) != 0) {
+            codecache_Invalidate(pageAddr, SIZE_PAGE);
+        }
+
+        leaf->rd[page] = NULL;
+        leaf->wr[page] = NULL;
+        leaf->host[page] = NULL;
     }
 }
 
 void* memory_GetPointer(const u32 addr) {
-    const u32 page = addr / SIZE_PAGE;
+    const Leaf* leaf = GetLeaf(addr);
+
+    const u32 page = GetLeafPage(addr);
     const u32 offset = addr & (SIZE_PAGE - 1);
 
-    if (ctx.tableRd[page] != NULL) {
-        return &ctx.tableRd[page][offset];
+    if (leaf->host[page] != NULL) {
+        return &leaf->host[page][offset];
     }
 
-    if (ctx.tableWr[page] != NULL) {
-        return &ctx.tableWr[page][offset];
+    return NULL;
+}
+
+void* memory_GetSpan(const u32 addr, const u32 size, const int write) {
+    const Leaf* leaf = GetLeaf(addr);
+
+    const u32 page = GetLeafPage(addr);
+    const u32 offset = addr & (SIZE_PAGE - 1);
+
+    if ((offset + size) > SIZE_PAGE) {
+        return NULL;
     }
 
-    return NULL;
+    // Code pages aren't writable through the fast path
+    u8* mem = (write) ? leaf->wr[page] : leaf->rd[page];
+
+    if (mem == NULL) {
+        return NULL;
+    }
+
+    return &mem[offset];
+}
+
+void memory_CopyToGuest(const u32 addr, const void* data, const u32 size) {
+    const u8* src = data;
+
+    for (u32 i = 0; i < size;) {
+        const u32 chunkAddr = addr + i;
+        const u32 chunkSize = GetChunkSize(chunkAddr, size - i);
+
+        u8 trap;
+
+        u8* mem = BeginWrite(chunkAddr, &trap);
+
+        if (mem != NULL) {
+            memcpy(mem, &src[i], chunkSize);
+
+            EndWrite(chunkAddr, chunkSize, trap);
+        } else {
+            for (u32 j = 0; j < chunkSize; j++) {
+                memory_Write8(chunkAddr + j, src[i + j]);
+            }
+        }
+
+        i += chunkSize;
+    }
+}
+
+void memory_CopyFromGuest(void* data, const u32 addr, const u32 size) {
+    u8* dst = data;
+
+    for (u32 i = 0; i < size;) {
+        const u32 chunkAddr = addr + i;
+        const u32 chunkSize = GetChunkSize(chunkAddr, size - i);
+
+        int isWatched;
+
+        const u8* mem = BeginRead(chunkAddr, &isWatched);
+
+        if (mem != NULL) {
+            memcpy(&dst[i], mem, chunkSize);
+
+            EndRead(chunkAddr, chunkSize, isWatched);
+        } else {
+            for (u32 j = 0; j < chunkSize; j++) {
+                dst[i + j] = memory_Read8(chunkAddr + j);
+            }
+        }
+
+        i += chunkSize;
+    }
+}
+
+void memory_CopyToGuest32(const u32 addr, const u32* data, const u32 count) {
+    assert(common_IsAligned(addr, sizeof(u32)));
+
+    const u32 size = sizeof(u32) * count;
+
+    for (u32 i = 0; i < size;) {
+        const u32 chunkAddr = addr + i;
+        const u32 chunkSize = GetChunkSize(chunkAddr, size - i);
+
+        u8 trap;
+
+        u8* mem = BeginWrite(chunkAddr, &trap);
+
+        if (mem != NULL) {
+            common_Bswap32Array(mem, &data[i / sizeof(u32)], chunkSize / sizeof(u32));
+
+            EndWrite(chunkAddr, chunkSize, trap);
+        } else {
+            for (u32 j = 0; j < chunkSize; j += sizeof(u32)) {
+                memory_Write32(chunkAddr + j, data[(i + j) / sizeof(u32)]);
+            }
+        }
+
+        i += chunkSize;
+    }
+}
+
+void memory_CopyFromGuest32(u32* data, const u32 addr, const u32 count) {
+    assert(common_IsAligned(addr, sizeof(u32)));
+
+    const u32 size = sizeof(u32) * count;
+
+    for (u32 i = 0; i < size;) {
+        const u32 chunkAddr = addr + i;
+        const u32 chunkSize = GetChunkSize(chunkAddr, size - i);
+
+        int isWatched;
+
+        const u8* mem = BeginRead(chunkAddr, &isWatched);
+
+        if (mem != NULL) {
+            common_Bswap32Array(&data[i / sizeof(u32)], mem, chunkSize / sizeof(u32));
+
+            EndRead(chunkAddr, chunkSize, isWatched);
+        } else {
+            for (u32 j = 0; j < chunkSize; j += sizeof(u32)) {
+                data[(i + j) / sizeof(u32)] = memory_Read32(chunkAddr + j);
+            }
+        }
+
+        i += chunkSize;
+    }
+}
+
+void memory_FillGuest(const u32 addr, const u8 data, const u32 size) {
+    for (u32 i = 0; i < size;) {
+        const u32 chunkAddr = addr + i;
+        const u32 chunkSize = GetChunkSize(chunkAddr, size - i);
+
+        u8 trap;
+
+        u8* mem = BeginWrite(chunkAddr, &trap);
+
+        if (mem != NULL) {
+            memset(mem, data, chunkSize);
+
+            EndWrite(chunkAddr, chunkSize, trap);
+        } else {
+            for (u32 j = 0; j < chunkSize; j++) {
+                memory_Write8(chunkAddr + j, data);
+            }
+        }
+
+        i += chunkSize;
+    }
+}
+
+void memory_CopyStringToGuest(const u32 addr, const char* str, const u32 size) {
+    const usize length = strnlen(str, size);
+
+    memory_CopyToGuest(addr, str, length);
+    memory_FillGuest(addr + length, 0, size - length);
+}
+
+void memory_CopyStringFromGuest(char* str, const u32 addr, const u32 size) {
+    assert(size != 0);
+
+    for (u32 i = 0; i < size; i++) {
+        str[i] = memory_Read8(addr + i);
+
+        if (str[i] == '\0') {
+            return;
+        }
+    }
+
+    str[size - 1] = '\0';
+}
+
+int memory_ProtectCode(const u32 addr) {
+    Leaf* leaf = GetLeaf(addr);
+
+    const u32 page = GetLeafPage(addr);
+
+    if (leaf->host[page] == NULL) {
+        // Code can only live in RAM
+        return NOUWII_FALSE;
+    }
+
+    if ((atomic_fetch_or(&leaf->flags[page], PAGE_CODE) & PAGE_CODE) == 0) {
+        // Route writes through the slow path
+        UpdateFastPath(leaf, page);
+    }
+
+    return NOUWII_TRUE;
+}
+
+int memory_IsCodeProtected(const u32 addr) {
+    return (atomic_load(&GetLeaf(addr)->flags[GetLeafPage(addr)]) & PAGE_CODE) != 0;
+}
+
+void memory_UnprotectCode(const u32 addr) {
+    if (memory_IsCodeProtected(addr)) {
+        InvalidateCode(addr);
+    }
+}
+
+void memory_CollectDirty(const int tracker, u64* bitmap) {
+    assert((tracker >= 0) && (tracker < MEMORY_NUM_DIRTY_TRACKERS));
+
+    // Every tracker gets the pages, then they are write-protected again, everything on the first collection
+    for (u32 word = 0; word < MEMORY_SIZE_DIRTY_BITMAP; word++) {
+        if (ctx.dirty[word] != 0) {
+            for (int i = 0; i < MEMORY_NUM_DIRTY_TRACKERS; i++) {
+                ctx.trackers[i][word] |= ctx.dirty[word];
+            }
+        }
+
+        for (u64 bits = (ctx.isTrackingDirty) ? ctx.dirty[word] : ~(u64)0; bits != 0; bits &= bits - 1) {
+            const u32 addr = memory_GetRamPageAddr(64 * word + __builtin_ctzll(bits));
+
+            Leaf* leaf = GetLeaf(addr);
+
+            const u32 page = GetLeafPage(addr);
+
+            atomic_fetch_or(&leaf->flags[page], PAGE_CLEAN);
+
+            UpdateFastPath(leaf, page);
+        }
+    }
+
+    memset(ctx.dirty, 0, sizeof(ctx.dirty));
+
+    ctx.isTrackingDirty = NOUWII_TRUE;
+
+    memcpy(bitmap, ctx.trackers[tracker], sizeof(ctx.trackers[tracker]));
+    memset(ctx.trackers[tracker], 0, sizeof(ctx.trackers[tracker]));
+}
+
+void memory_MarkDirty(const u32 ramPage) {
+    assert(ramPage < MEMORY_NUM_RAM_PAGES);
+
+    ctx.dirty[ramPage / 64] |= (u64)1 << (ramPage & 63);
+}
+
+u64 memory_GetNumIoAccesses() {
+    return ctx.numIoAccesses;
+}
+
+u8* memory_GetRamPage(const u32 ramPage) {
+    assert(ramPage < MEMORY_NUM_RAM_PAGES);
+
+    if (ramPage < NUM_MEM1_PAGES) {
+        return &ctx.mem1[SIZE_PAGE * ramPage];
+    }
+
+    return &ctx.mem2[SIZE_PAGE * (ramPage - NUM_MEM1_PAGES)];
+}
+
+u32 memory_GetRamPageAddr(const u32 ramPage) {
+    if (ramPage < NUM_MEM1_PAGES) {
+        return BASE_MEM1 + SIZE_PAGE * ramPage;
+    }
+
+    return BASE_MEM2 + SIZE_PAGE * (ramPage - NUM_MEM1_PAGES);
+}
+
+void memory_SetFaultHandler(const memory_FaultHandler handler) {
+    ctx.faultHandler = handler;
+}
+
+void memory_AddWatchpoint(const u32 addr, const u32 size, const int type) {
+    assert(size != 0);
+
+    if (ctx.numWatchpoints == MAX_WATCHPOINTS) {
+        printf("Memory Too many watchpoints\n");
+        exit(1);
+    }
+
+    Watchpoint* watchpoint = &ctx.watchpoints[ctx.numWatchpoints++];
+
+    watchpoint->addr = addr;
+    watchpoint->size = size;
+    watchpoint->type = type;
+
+    const u8 flags = (((type & MEMORY_WATCH_READ) != 0) ? PAGE_WATCH_READ : 0) | (((type & MEMORY_WATCH_WRITE) != 0) ? PAGE_WATCH_WRITE : 0);
+
+    // Only accesses to the watched pages leave the fast path
+    for (u64 pageAddr = addr & ~(SIZE_PAGE - 1); pageAddr < ((u64)addr + size); pageAddr += SIZE_PAGE) {
+        Leaf* leaf = GetLeaf(pageAddr);
+
+        if (leaf == &emptyLeaf) {
+            continue;
+        }
+
+        const u32 page = GetLeafPage(pageAddr);
+
+        atomic_fetch_or(&leaf->flags[page], flags);
+
+        UpdateFastPath(leaf, page);
+    }
+}
+
+void memory_ClearWatchpoints() {
+    for (int i = 0; i < ctx.numWatchpoints; i++) {
+        const Watchpoint* watchpoint = &ctx.watchpoints[i];
+
+        for (u64 pageAddr = watchpoint->addr & ~(SIZE_PAGE - 1); pageAddr < ((u64)watchpoint->addr + watchpoint->size); pageAddr += SIZE_PAGE) {
+            Leaf* leaf = GetLeaf(pageAddr);
+
+            if (leaf == &emptyLeaf) {
+                continue;
+            }
+
+            const u32 page = GetLeafPage(pageAddr);
+
+            atomic_fetch_and(&leaf->flags[page], (u8)~(PAGE_WATCH_READ | PAGE_WATCH_WRITE));
+
+            UpdateFastPath(leaf, page);
+        }
+    }
+
+    ctx.numWatchpoints = 0;
+}
+
+void memory_SetWatchHandler(const memory_WatchHandler handler) {
+    ctx.watchHandler = handler;
 }
@@ -0,0 +1,443 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "core/profiler.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/instance.h"
+#include "core/scheduler.h"
+
+#include "hw/broadway.h"
+
+#define MAX_LINE (1024)
+#define MAX_PATH (4096)
+
+#define MIN_SAMPLE_SLOTS (0x1000)
+
+#define NUM_TOP_FUNCTIONS (20)
+
+#define BASE_CACHED (0x80000000)
+
+typedef struct Symbol {
+    u32 addr;
+    u32 size;
+
+    char* name;
+} Symbol;
+
+// Histogram slot, keyed by the caller (LR) in the upper and CIA in the lower word
+typedef struct Sample {
+    u64 key;
+    u64 count;
+} Sample;
+
+// Function a sampled address belongs to, name is NULL if it isn't in the symbol map
+typedef struct Frame {
+    const char* name;
+
+    u32 addr;
+} Frame;
+
+typedef struct Entry {
+    Frame caller;
+    Frame callee;
+
+    u64 count;
+} Entry;
+
+typedef struct Context {
+    i64 interval;
+
+    // Sorted by address
+    Symbol* symbols;
+
+    u32 numSymbols;
+
+    // Open addressing, empty slots have a count of 0
+    Sample* samples;
+
+    u32 numSlots;
+    u32 numSamples;
+
+    u64 totalSamples;
+} Context;
+
+#define ctx INSTANCE_CONTEXT(INSTANCE_PROFILER, Context)
+
+static u32 HashKey(const u64 key) {
+    return (u32)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static Sample* FindSlot(Sample* samples, const u32 numSlots, const u64 key) {
+    for (u32 slot = HashKey(key) & (numSlots - 1);; slot = (slot + 1) & (numSlots - 1)) {
+        Sample* sample = &samples[slot];
+
+        if ((sample->count == 0) || (sample->key == key)) {
+            return sample;
+        }
+    }
+}
+
+static void Grow() {
+    const u32 numSlots = (ctx.numSlots == 0) ? MIN_SAMPLE_SLOTS : 2 * ctx.numSlots;
+
+    Sample* samples = calloc(numSlots, sizeof(Sample));
+
+    if (samples == NULL) {
+        printf("Profiler Failed to allocate histogram\n");
+        exit(1);
+    }
+
+    for (u32 slot = 0; slot < ctx.numSlots; slot++) {
+        const Sample* sample = &ctx.samples[slot];
+
+        if (sample->count != 0) {
+            *FindSlot(samples, numSlots, sample->key) = *sample;
+        }
+    }
+
+    free(ctx.samples);
+
+    ctx.samples = samples;
+    ctx.numSlots = numSlots;
+}
+
+static void AddSample(const u32 cia, const u32 lr) {
+    if ((2 * (ctx.numSamples + 1)) > ctx.numSlots) {
+        Grow();
+    }
+
+    const u64 key = ((u64)lr << 32) | cia;
+
+    Sample* sample = FindSlot(ctx.samples, ctx.numSlots, key);
+
+    if (sample->count == 0) {
+        sample->key = key;
+
+        ctx.numSamples++;
+    }
+
+    sample->count++;
+
+    ctx.totalSamples++;
+}
+
+static void SampleEvent(const int) {
+    scheduler_ScheduleEvent("profiler_Sample", SampleEvent, 0, ctx.interval);
+
+    AddSample(broadway_GetCia(), broadway_GetLr());
+}
+
+static void FreeSymbols() {
+    for (u32 i = 0; i < ctx.numSymbols; i++) {
+        free(ctx.symbols[i].name);
+    }
+
+    free(ctx.symbols);
+
+    ctx.symbols = NULL;
+    ctx.numSymbols = 0;
+}
+
+static int CompareSymbols(const void* a, const void* b) {
+    const Symbol* symbolA = a;
+    const Symbol* symbolB = b;
+
+    return (symbolA->addr > symbolB->addr) - (symbolA->addr < symbolB->addr);
+}
+
+static const Symbol* FindSymbol(const u32 addr) {
+    // Last symbol at or below addr
+    u32 lo = 0;
+    u32 hi = ctx.numSymbols;
+
+    while (lo < hi) {
+        const u32 mid = lo + (hi - lo) / 2;
+
+        if (ctx.symbols[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) {
+        return NULL;
+    }
+
+    const Symbol* symbol = &ctx.symbols[lo - 1];
+
+    if ((symbol->size != 0) && ((addr - symbol->addr) >= symbol->size)) {
+        return NULL;
+    }
+
+    return symbol;
+}
+
+static Frame ResolveFrame(const u32 addr) {
+    const Symbol* symbol = FindSymbol(addr);
+
+    if ((symbol == NULL) && (addr < BASE_CACHED)) {
+        // Fetched with translation off, maps list cached addresses
+        symbol = FindSymbol(addr | BASE_CACHED);
+    }
+
+    Frame frame;
+
+    if (symbol != NULL) {
+        frame.name = symbol->name;
+        frame.addr = symbol->addr;
+    } else {
+        frame.name = NULL;
+        frame.addr = addr;
+    }
+
+    return frame;
+}
+
+static int CompareFrames(const Frame* a, const Frame* b) {
+    if ((a->name != NULL) && (b->name != NULL)) {
+        return strcmp(a->name, b->name);
+    }
+
+    if ((a->name != NULL) != (b->name != NULL)) {
+        return (a->name != NULL) ? 1 : -1;
+    }
+
+    return (a->addr > b->addr) - (a->addr < b->addr);
+}
+
+static int CompareEntries(const void* a, const void* b) {
+    const Entry* entryA = a;
+    const Entry* entryB = b;
+
+    const int cmp = CompareFrames(&entryA->caller, &entryB->caller);
+
+    if (cmp != 0) {
+        return cmp;
+    }
+
+    return CompareFrames(&entryA->callee, &entryB->callee);
+}
+
+static int CompareCallees(const void* a, const void* b) {
+    return CompareFrames(&((const Entry*)a)->callee, &((const Entry*)b)->callee);
+}
+
+static int CompareCounts(const void* a, const void* b) {
+    const Entry* entryA = a;
+    const Entry* entryB = b;
+
+    return (entryA->count < entryB->count) - (entryA->count > entryB->count);
+}
+
+static void PrintFrame(FILE* file, const Frame* frame) {
+    if (frame->name != NULL) {
+        fputs(frame->name, file);
+    } else {
+        fprintf(file, "%08X", frame->addr);
+    }
+}
+
+// Merges adjacent entries that compare equal, returns the new number of entries
+static u32 MergeEntries(Entry* entries, const u32 numEntries, int (*compare)(const void*, const void*)) {
+    u32 n = 0;
+
+    for (u32 i = 0; i < numEntries; i++) {
+        if ((n != 0) && (compare(&entries[n - 1], &entries[i]) == 0)) {
+            entries[n - 1].count += entries[i].count;
+        } else {
+            entries[n++] = entries[i];
+        }
+    }
+
+    return n;
+}
+
+void profiler_Initialize() {
+    instance_CreateContext(INSTANCE_PROFILER, sizeof(Context));
+}
+
+void profiler_Reset() {
+    free(ctx.samples);
+
+    ctx.samples = NULL;
+    ctx.numSlots = 0;
+    ctx.numSamples = 0;
+    ctx.totalSamples = 0;
+
+    if (ctx.interval == 0) {
+        return;
+    }
+
+    scheduler_ScheduleEvent("profiler_Sample", SampleEvent, 0, ctx.interval);
+}
+
+void profiler_Shutdown() {
+    FreeSymbols();
+
+    free(ctx.samples);
+
+    instance_DestroyContext(INSTANCE_PROFILER);
+}
+
+void profiler_SetConfig(const i64 interval) {
+    assert(interval >= 0);
+
+    ctx.interval = interval;
+}
+
+void profiler_LoadSymbols(const char* pathDol) {
+    FreeSymbols();
+
+    // The map sits next to the DOL, foo.dol -> foo.map
+    char pathMap[MAX_PATH];
+
+    snprintf(pathMap, sizeof(pathMap), "%s", pathDol);
+
+    char* ext = strrchr(pathMap, '.');
+
+    if ((ext == NULL) || (strchr(ext, '/') != NULL)) {
+        ext = &pathMap[strlen(pathMap)];
+    }
+
+    snprintf(ext, sizeof(pathMap) - (ext - pathMap), ".map");
+
+    FILE* map = fopen(pathMap, "r");
+
+    if (map == NULL) {
+        printf("Profiler No symbol map at %s\n", pathMap);
+
+        return;
+    }
+
+    u32 maxSymbols = 0;
+
+    char line[MAX_LINE];
+
+    while (fgets(line, sizeof(line), map) != NULL) {
+        // CodeWarrior and Dolphin maps: [offset] [size] [virtual address] [alignment] [name] ...
+        u32 offset, size, addr, align;
+        char name[MAX_LINE];
+
+        if (sscanf(line, "%x %x %x %u %1023s", &offset, &size, &addr, &align, name) != 5) {
+            continue;
+        }
+
+        if ((name[0] == '.') || (size == 0)) {
+            // Section and object file entries
+            continue;
+        }
+
+        if (ctx.numSymbols == maxSymbols) {
+            maxSymbols = (maxSymbols == 0) ? 256 : 2 * maxSymbols;
+
+            ctx.symbols = realloc(ctx.symbols, maxSymbols * sizeof(Symbol));
+
+            if (ctx.symbols == NULL) {
+                printf("Profiler Failed to allocate symbols\n");
+                exit(1);
+            }
+        }
+
+        Symbol* symbol = &ctx.symbols[ctx.numSymbols++];
+
+        symbol->addr = addr;
+        symbol->size = size;
+        symbol->name = strdup(name);
+    }
+
+    fclose(map);
+
+    qsort(ctx.symbols, ctx.numSymbols, sizeof(Symbol), CompareSymbols);
+
+    printf("Profiler Loaded %u symbols from %s\n", ctx.numSymbols, pathMap);
+}
+
+const char* profiler_GetSymbol(const u32 addr) {
+    return ResolveFrame(addr).name;
+}
+
+void profiler_WriteReport(const char* path) {
+    if (ctx.totalSamples == 0) {
+        printf("Profiler No samples\n");
+
+        return;
+    }
+
+    Entry* entries = malloc(ctx.numSamples * sizeof(Entry));
+
+    if (entries == NULL) {
+        printf("Profiler Failed to allocate report\n");
+        exit(1);
+    }
+
+    u32 numEntries = 0;
+
+    for (u32 slot = 0; slot < ctx.numSlots; slot++) {
+        const Sample* sample = &ctx.samples[slot];
+
+        if (sample->count == 0) {
+            continue;
+        }
+
+        Entry* entry = &entries[numEntries++];
+
+        // LR points past the call
+        entry->caller = ResolveFrame((u32)(sample->key >> 32) - sizeof(u32));
+        entry->callee = ResolveFrame((u32)sample->key);
+        entry->count = sample->count;
+    }
+
+    // Collapsed stacks, one "caller;callee count" line per pair
+    FILE* file = fopen(path, "w");
+
+    if (file == NULL) {
+        printf("Profiler Unable to open %s\n", path);
+        exit(1);
+    }
+
+    qsort(entries, numEntries, sizeof(Entry), CompareEntries);
+
+    numEntries = MergeEntries(entries, numEntries, CompareEntries);
+
+    for (u32 i = 0; i < numEntries; i++) {
+        const Entry* entry = &entries[i];
+
+        if (CompareFrames(&entry->caller, &entry->callee) != 0) {
+            // LR is stale in functions that already returned from a call
+            PrintFrame(file, &entry->caller);
+            fputc(';', file);
+        }
+
+        PrintFrame(file, &entry->callee);
+        fprintf(file, " %llu\n", (unsigned long long)entry->count);
+    }
+
+    fclose(file);
+
+    // Top functions by self time
+    qsort(entries, numEntries, sizeof(Entry), CompareCallees);
+
+    numEntries = MergeEntries(entries, numEntries, CompareCallees);
+
+    qsort(entries, numEntries, sizeof(Entry), CompareCounts);
+
+    printf("Profiler %llu samples, collapsed stacks written to %s\n", (unsigned long long)ctx.totalSamples, path);
+
+    for (u32 i = 0; (i < numEntries) && (i < NUM_TOP_FUNCTIONS); i++) {
+        const Entry* entry = &entries[i];
+
+        printf("Profiler %6.2f%% %10llu ", 100.0 * entry->count / ctx.totalSamples, (unsigned long long)entry->count);
+        PrintFrame(stdout, &entry->callee);
+        putchar('\n');
+    }
+
+    free(entries);
+}
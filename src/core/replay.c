@@ -0,0 +1,163 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "core/replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/instance.h"
+#include "core/scheduler.h"
+
+#define MAGIC   (0x4C52574E) // NWRL
+#define VERSION (1)
+
+// Inputs are small and frequent, batch them into large writes
+#define SIZE_BUFFER (0x100000)
+
+typedef struct Header {
+    u32 magic;
+    u32 version;
+} Header;
+
+// Followed by size bytes of input, all in host byte order
+typedef struct Record {
+    i64 timestamp;
+
+    u32 type;
+    u32 size;
+} Record;
+
+typedef struct Context {
+    const char* pathRecord;
+    const char* pathReplay;
+
+    FILE* log;
+
+    // Record number, for error messages
+    u64 numRecords;
+} Context;
+
+#define ctx INSTANCE_CONTEXT(INSTANCE_REPLAY, Context)
+
+static void CloseLog() {
+    if (ctx.log != NULL) {
+        fclose(ctx.log);
+
+        ctx.log = NULL;
+    }
+}
+
+static FILE* OpenLog(const char* path, const char* mode) {
+    FILE* log = fopen(path, mode);
+
+    if (log == NULL) {
+        printf("Replay Unable to open %s\n", path);
+        exit(1);
+    }
+
+    setvbuf(log, NULL, _IOFBF, SIZE_BUFFER);
+
+    return log;
+}
+
+static void Read(void* data, const usize size) {
+    if (fread(data, 1, size, ctx.log) != size) {
+        printf("Replay Log ended at record %llu (timestamp: %lld)\n", (unsigned long long)ctx.numRecords, (long long)scheduler_GetTimestamp());
+        exit(1);
+    }
+}
+
+static void Write(const void* data, const usize size) {
+    if (fwrite(data, 1, size, ctx.log) != size) {
+        printf("Replay Failed to write record %llu\n", (unsigned long long)ctx.numRecords);
+        exit(1);
+    }
+}
+
+void replay_Initialize() {
+    instance_CreateContext(INSTANCE_REPLAY, sizeof(Context));
+}
+
+void replay_Reset() {
+    CloseLog();
+
+    ctx.numRecords = 0;
+
+    Header header;
+
+    if (ctx.pathReplay != NULL) {
+        ctx.log = OpenLog(ctx.pathReplay, "rb");
+
+        Read(&header, sizeof(header));
+
+        if ((header.magic != MAGIC) || (header.version != VERSION)) {
+            printf("Replay %s is not a version %d log\n", ctx.pathReplay, VERSION);
+            exit(1);
+        }
+
+        printf("Replay Playing back %s\n", ctx.pathReplay);
+    } else if (ctx.pathRecord != NULL) {
+        // Every reset starts a new session
+        ctx.log = OpenLog(ctx.pathRecord, "wb");
+
+        header.magic = MAGIC;
+        header.version = VERSION;
+
+        Write(&header, sizeof(header));
+
+        printf("Replay Recording to %s\n", ctx.pathRecord);
+    }
+}
+
+void replay_Shutdown() {
+    CloseLog();
+
+    instance_DestroyContext(INSTANCE_REPLAY);
+}
+
+void replay_SetConfig(const char* pathRecord, const char* pathReplay) {
+    if ((pathRecord != NULL) && (pathReplay != NULL)) {
+        printf("Replay Can't record and replay at the same time\n");
+        exit(1);
+    }
+
+    ctx.pathRecord = pathRecord;
+    ctx.pathReplay = pathReplay;
+}
+
+int replay_IsReplaying() {
+    return ctx.pathReplay != NULL;
+}
+
+void replay_Input(const int type, void* data, const u32 size) {
+    if (ctx.log == NULL) {
+        return;
+    }
+
+    Record record;
+
+    if (ctx.pathReplay != NULL) {
+        Read(&record, sizeof(record));
+
+        // Inputs are requested from scheduler events, a different time means the guest diverged
+        if ((record.type != (u32)type) || (record.size != size) || (record.timestamp != scheduler_GetTimestamp())) {
+            printf("Replay Divergence at record %llu (expected type: %u, size: %u, timestamp: %lld; got type: %d, size: %u, timestamp: %lld)\n", (unsigned long long)ctx.numRecords, record.type, record.size, (long long)record.timestamp, type, size, (long long)scheduler_GetTimestamp());
+            exit(1);
+        }
+
+        Read(data, size);
+    } else {
+        record.timestamp = scheduler_GetTimestamp();
+        record.type = type;
+        record.size = size;
+
+        Write(&record, sizeof(record));
+        Write(data, size);
+    }
+
+    ctx.numRecords++;
+}
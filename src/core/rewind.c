@@ -0,0 +1,337 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "core/rewind.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "common/delta.h"
+
+#include "core/codecache.h"
+#include "core/instance.h"
+#include "core/memory.h"
+#include "core/scheduler.h"
+
+#define MAX_SNAPSHOTS (256)
+
+#define SIZE_RAM (MEMORY_NUM_RAM_PAGES * MEMORY_SIZE_PAGE)
+
+// Modules with guest-visible state. Memory is handled page by page,
+// the code cache and the loader only hold host state
+static const int stateModules[] = {
+    INSTANCE_HLE,
+    INSTANCE_SCHEDULER,
+    INSTANCE_AI,
+    INSTANCE_BROADWAY,
+    INSTANCE_DI,
+    INSTANCE_DSP,
+    INSTANCE_EXI,
+    INSTANCE_HOLLYWOOD,
+    INSTANCE_IPC,
+    INSTANCE_PI,
+};
+
+#define NUM_STATE_MODULES ((int)(sizeof(stateModules) / sizeof(stateModules[0])))
+
+typedef struct PageDelta {
+    u32 ramPage;
+    u32 sizeDelta;
+} PageDelta;
+
+// Module contexts at capture time, followed by the page deltas that take
+// RAM from this snapshot back to the previous one
+typedef struct Snapshot {
+    u8* data;
+
+    usize size;
+} Snapshot;
+
+typedef struct Context {
+    i64 interval;
+    usize budget;
+
+    // RAM as of the newest snapshot
+    u8* shadow;
+
+    int hasShadow;
+
+    // Pages that differ between RAM and the shadow without being dirty
+    u64 pending[MEMORY_SIZE_DIRTY_BITMAP];
+
+    u64 changed[MEMORY_SIZE_DIRTY_BITMAP];
+
+    Snapshot snapshots[MAX_SNAPSHOTS];
+
+    u32 first;
+    u32 numSnapshots;
+
+    usize totalSize;
+
+    // Snapshot under construction
+    u8* scratch;
+
+    usize sizeScratch;
+} Context;
+
+#define ctx INSTANCE_CONTEXT(INSTANCE_REWIND, Context)
+
+static void Reserve(const usize size) {
+    if (size <= ctx.sizeScratch) {
+        return;
+    }
+
+    ctx.sizeScratch = 2 * size;
+    ctx.scratch = realloc(ctx.scratch, ctx.sizeScratch);
+
+    if (ctx.scratch == NULL) {
+        printf("Rewind Failed to allocate %zu bytes\n", ctx.sizeScratch);
+        exit(1);
+    }
+}
+
+static Snapshot* GetSnapshot(const u32 idx) {
+    return &ctx.snapshots[(ctx.first + idx) % MAX_SNAPSHOTS];
+}
+
+static void DropOldest() {
+    Snapshot* snapshot = GetSnapshot(0);
+
+    ctx.totalSize -= snapshot->size;
+
+    free(snapshot->data);
+
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    ctx.first = (ctx.first + 1) % MAX_SNAPSHOTS;
+    ctx.numSnapshots--;
+}
+
+static void FreeSnapshots() {
+    while (ctx.numSnapshots != 0) {
+        DropOldest();
+    }
+}
+
+// Collects the pages that may differ from the shadow
+static void CollectChanged(u64* bitmap) {
+    memory_CollectDirty(MEMORY_DIRTY_REWIND, bitmap);
+
+    for (int i = 0; i < MEMORY_SIZE_DIRTY_BITMAP; i++) {
+        bitmap[i] |= ctx.pending[i];
+    }
+
+    memset(ctx.pending, 0, sizeof(ctx.pending));
+}
+
+static void InitializeShadow() {
+    static const u8 zeroPage[MEMORY_SIZE_PAGE];
+
+    if (ctx.shadow == NULL) {
+        ctx.shadow = mmap(NULL, SIZE_RAM, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (ctx.shadow == MAP_FAILED) {
+            printf("Rewind Failed to allocate shadow RAM\n");
+            exit(1);
+        }
+    }
+
+    // The shadow starts out zeroed, untouched pages stay shared with the zero page
+    for (u32 ramPage = 0; ramPage < MEMORY_NUM_RAM_PAGES; ramPage++) {
+        const u8* mem = memory_GetRamPage(ramPage);
+
+        if (memcmp(mem, zeroPage, MEMORY_SIZE_PAGE) != 0) {
+            memcpy(&ctx.shadow[MEMORY_SIZE_PAGE * ramPage], mem, MEMORY_SIZE_PAGE);
+        }
+    }
+
+    ctx.hasShadow = NOUWII_TRUE;
+}
+
+static void Capture() {
+    CollectChanged(ctx.changed);
+
+    usize size = 0;
+
+    for (int i = 0; i < NUM_STATE_MODULES; i++) {
+        usize sizeContext;
+
+        const void* context = instance_GetContext(stateModules[i], &sizeContext);
+
+        Reserve(size + sizeContext);
+
+        memcpy(&ctx.scratch[size], context, sizeContext);
+
+        size += sizeContext;
+    }
+
+    if (!ctx.hasShadow) {
+        // First snapshot, there is nothing to go back to
+        InitializeShadow();
+    } else {
+        for (u32 ramPage = 0; ramPage < MEMORY_NUM_RAM_PAGES; ramPage++) {
+            if ((ctx.changed[ramPage / 64] & ((u64)1 << (ramPage & 63))) == 0) {
+                continue;
+            }
+
+            u8* shadow = &ctx.shadow[MEMORY_SIZE_PAGE * ramPage];
+
+            const u8* mem = memory_GetRamPage(ramPage);
+
+            Reserve(size + sizeof(PageDelta) + COMMON_MAX_DELTA_SIZE(MEMORY_SIZE_PAGE));
+
+            PageDelta delta;
+            delta.ramPage = ramPage;
+            delta.sizeDelta = common_EncodeXorDelta(mem, shadow, MEMORY_SIZE_PAGE, &ctx.scratch[size + sizeof(PageDelta)]);
+
+            if (delta.sizeDelta == 0) {
+                // Written to, but with the same data
+                continue;
+            }
+
+            memcpy(&ctx.scratch[size], &delta, sizeof(PageDelta));
+
+            size += sizeof(PageDelta) + delta.sizeDelta;
+
+            memcpy(shadow, mem, MEMORY_SIZE_PAGE);
+        }
+    }
+
+    // Make room, the newest snapshot is always kept
+    while ((ctx.numSnapshots != 0) && ((ctx.numSnapshots == MAX_SNAPSHOTS) || ((ctx.totalSize + size) > ctx.budget))) {
+        DropOldest();
+    }
+
+    Snapshot* snapshot = GetSnapshot(ctx.numSnapshots);
+
+    snapshot->data = malloc(size);
+
+    if (snapshot->data == NULL) {
+        printf("Rewind Failed to allocate snapshot\n");
+        exit(1);
+    }
+
+    memcpy(snapshot->data, ctx.scratch, size);
+
+    snapshot->size = size;
+
+    ctx.numSnapshots++;
+    ctx.totalSize += size;
+}
+
+static void CaptureEvent(const int) {
+    // Schedule first, the captured scheduler state must include the next capture
+    scheduler_ScheduleEvent("rewind_Capture", CaptureEvent, 0, ctx.interval);
+
+    Capture();
+}
+
+void rewind_Initialize() {
+    instance_CreateContext(INSTANCE_REWIND, sizeof(Context));
+}
+
+void rewind_Reset() {
+    FreeSnapshots();
+
+    memset(ctx.pending, 0, sizeof(ctx.pending));
+
+    if (ctx.hasShadow) {
+        madvise(ctx.shadow, SIZE_RAM, MADV_DONTNEED);
+    }
+
+    ctx.hasShadow = NOUWII_FALSE;
+
+    if (ctx.interval != 0) {
+        scheduler_ScheduleEvent("rewind_Capture", CaptureEvent, 0, ctx.interval);
+    }
+}
+
+void rewind_Shutdown() {
+    FreeSnapshots();
+
+    if (ctx.shadow != NULL) {
+        munmap(ctx.shadow, SIZE_RAM);
+    }
+
+    free(ctx.scratch);
+
+    instance_DestroyContext(INSTANCE_REWIND);
+}
+
+void rewind_SetConfig(const i64 interval, const usize budget) {
+    assert(interval >= 0);
+
+    ctx.interval = interval;
+    ctx.budget = budget;
+}
+
+void rewind_Capture() {
+    Capture();
+}
+
+int rewind_StepBack() {
+    if (ctx.numSnapshots == 0) {
+        return NOUWII_FALSE;
+    }
+
+    // Return RAM to the newest snapshot
+    CollectChanged(ctx.changed);
+
+    for (u32 ramPage = 0; ramPage < MEMORY_NUM_RAM_PAGES; ramPage++) {
+        if ((ctx.changed[ramPage / 64] & ((u64)1 << (ramPage & 63))) != 0) {
+            memcpy(memory_GetRamPage(ramPage), &ctx.shadow[MEMORY_SIZE_PAGE * ramPage], MEMORY_SIZE_PAGE);
+
+            // Other trackers haven't seen this write
+            memory_MarkDirty(ramPage);
+
+            memory_UnprotectCode(memory_GetRamPageAddr(ramPage));
+        }
+    }
+
+    Snapshot* snapshot = GetSnapshot(ctx.numSnapshots - 1);
+
+    usize offset = 0;
+
+    for (int i = 0; i < NUM_STATE_MODULES; i++) {
+        usize sizeContext;
+
+        void* context = instance_GetContext(stateModules[i], &sizeContext);
+
+        memcpy(context, &snapshot->data[offset], sizeContext);
+
+        offset += sizeContext;
+    }
+
+    // The previous snapshot becomes the newest, RAM now differs from it in the delta pages
+    while (offset < snapshot->size) {
+        PageDelta delta;
+
+        memcpy(&delta, &snapshot->data[offset], sizeof(PageDelta));
+
+        offset += sizeof(PageDelta);
+
+        common_ApplyXorDelta(&snapshot->data[offset], delta.sizeDelta, &ctx.shadow[MEMORY_SIZE_PAGE * delta.ramPage]);
+
+        offset += delta.sizeDelta;
+
+        ctx.pending[delta.ramPage / 64] |= (u64)1 << (delta.ramPage & 63);
+    }
+
+    ctx.totalSize -= snapshot->size;
+
+    free(snapshot->data);
+
+    memset(snapshot, 0, sizeof(*snapshot));
+
+    ctx.numSnapshots--;
+
+    // Restored address translation state
+    codecache_Unlink();
+
+    return NOUWII_TRUE;
+}
@@ -10,9 +10,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "core/instance.h"
+#include "core/stats.h"
+
 #include "hw/broadway.h"
 
-#define MAX_EVENTS (16)
+#define MAX_EVENTS (SCHEDULER_MAX_EVENTS)
 #define MAX_CYCLES_TO_RUN (128)
 
 typedef struct Event {
@@ -24,14 +27,25 @@ typedef struct Event {
     i64 cycles;
 } Event;
 
-static Event events[MAX_EVENTS];
-static Event* eventQueue[MAX_EVENTS];
+typedef struct Context {
+    Event events[MAX_EVENTS];
+    Event* eventQueue[MAX_EVENTS];
+
+    // Fires at the end of the current slice
+    Event* currentEvent;
+
+    // Guest time at the start of the current slice, and the slice's length
+    i64 timestamp;
+    i64 sliceCycles;
+} Context;
+
+#define ctx INSTANCE_CONTEXT(INSTANCE_SCHEDULER, Context)
 
 static Event* FindFreeEvent() {
     for (int i = 0; i < MAX_EVENTS; i++) {
-        Event* event = &events[i];
+        Event* event = &ctx.events[i];
 
-        if (event->cycles <= 0) {
+        if (event->callback == NULL) {
             return event;
         }
     }
@@ -43,11 +57,11 @@ static void AddEventToQueue(Event* event) {
     assert(event->cycles > 0);
 
     for (int i = 0; i < MAX_EVENTS; i++) {
-        Event** queuedEvent = &eventQueue[i];
+        Event** queuedEvent = &ctx.eventQueue[i];
 
         if ((*queuedEvent == NULL) || ((*queuedEvent)->cycles > event->cycles)) {
             if (i != (MAX_EVENTS - 1)) {
-                memmove(&eventQueue[i + 1], &eventQueue[i], sizeof(Event*) * (MAX_EVENTS - i - 1));
+                memmove(&ctx.eventQueue[i + 1], &ctx.eventQueue[i], sizeof(Event*) * (MAX_EVENTS - i - 1));
             }
 
             *queuedEvent = event;
@@ -62,7 +76,7 @@ static void AddEventToQueue(Event* event) {
 }
 
 static Event* GetNextEvent() {
-    Event** queuedEvent = &eventQueue[0];
+    Event** queuedEvent = &ctx.eventQueue[0];
 
     if (*queuedEvent == NULL) {
         // Event queue is empty
@@ -71,14 +85,14 @@ static Event* GetNextEvent() {
 
     Event* event = *queuedEvent;
 
-    memmove(&eventQueue[0], &eventQueue[1], sizeof(Event*) * (MAX_EVENTS - 1));
+    memmove(&ctx.eventQueue[0], &ctx.eventQueue[1], sizeof(Event*) * (MAX_EVENTS - 1));
 
     return event;
 }
 
 static void AdvanceEvents(const i64 cycles) {
     for (int i = 0; i < MAX_EVENTS; i++) {
-        Event* event = eventQueue[i];
+        Event* event = ctx.eventQueue[i];
 
         if (event == NULL) {
             return;
@@ -89,27 +103,56 @@ static void AdvanceEvents(const i64 cycles) {
 }
 
 void scheduler_Initialize() {
-
+    instance_CreateContext(INSTANCE_SCHEDULER, sizeof(Context));
 }
 
 void scheduler_Reset() {
-    memset(events, 0, sizeof(events));
-    memset(eventQueue, 0, sizeof(eventQueue));
+    memset(&ctx, 0, sizeof(ctx));
 }
 
 void scheduler_Shutdown() {
-
+    instance_DestroyContext(INSTANCE_SCHEDULER);
 }
 
 void scheduler_ScheduleEvent(const char* name, scheduler_Callback callback, const int arg, const i64 cycles) {
     Event* event = FindFreeEvent();
 
-    assert(event != NULL);
+    if (event == NULL) {
+        printf("Scheduler Too many pending events, can't add %s\n", name);
+
+        exit(1);
+    }
 
     event->name = name;
     event->callback = callback;
     event->arg = arg;
-    event->cycles = cycles - *broadway_GetCyclesToRun(); // Maybe?
+
+    i64* cyclesToRun = broadway_GetCyclesToRun();
+
+    if (cycles < *cyclesToRun) {
+        // Event is due before the end of the current slice, end the slice early
+        const i64 delta = *cyclesToRun - cycles;
+
+        *cyclesToRun = cycles;
+
+        ctx.sliceCycles -= delta;
+
+        AdvanceEvents(-delta);
+
+        if (ctx.currentEvent != NULL) {
+            ctx.currentEvent->cycles = delta;
+
+            AddEventToQueue(ctx.currentEvent);
+        }
+
+        event->cycles = 0;
+
+        ctx.currentEvent = event;
+
+        return;
+    }
+
+    event->cycles = cycles - *cyclesToRun; // Maybe?
 
     AddEventToQueue(event);
 }
@@ -117,20 +160,54 @@ void scheduler_ScheduleEvent(const char* name, scheduler_Callback callback, cons
 void scheduler_Run() {
     i64 cycles = MAX_CYCLES_TO_RUN;
 
-    Event* event = GetNextEvent();
+    ctx.currentEvent = GetNextEvent();
 
-    if (event != NULL) {
-        cycles = event->cycles;
+    if (ctx.currentEvent != NULL) {
+        cycles = ctx.currentEvent->cycles;
     }
 
     AdvanceEvents(cycles);
 
-    *broadway_GetCyclesToRun() = cycles;
+    i64* cyclesToRun = broadway_GetCyclesToRun();
+
+    *cyclesToRun = cycles;
+
+    ctx.sliceCycles = cycles;
+
+    const stats_Scope scope = stats_Begin();
 
     broadway_Run();
 
+    stats_End(scope, "Broadway", 0);
+
+    // Slices can overshoot by a few cycles
+    ctx.timestamp += ctx.sliceCycles - *cyclesToRun;
+
+    ctx.sliceCycles = 0;
+
+    *cyclesToRun = 0;
+
+    Event* event = ctx.currentEvent;
+
+    ctx.currentEvent = NULL;
+
     if (event != NULL) {
-        event->callback(event->arg);
+        const scheduler_Callback callback = event->callback;
+
+        // Free the event first, the callback may schedule a new one
+        event->callback = NULL;
         event->cycles = 0;
+
+        const char* name = event->name;
+
+        const stats_Scope scope = stats_Begin();
+
+        callback(event->arg);
+
+        stats_End(scope, name, 0);
     }
 }
+
+i64 scheduler_GetTimestamp() {
+    return ctx.timestamp + ctx.sliceCycles - *broadway_GetCyclesToRun();
+}
@@ -0,0 +1,217 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "core/stats.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "core/instance.h"
+#include "core/scheduler.h"
+
+#define MAX_COUNTERS (256)
+#define MAX_DEPTH    (16)
+
+typedef struct Counter {
+    // Copied, counters outlive the names they were created with
+    char* name;
+
+    u32 id;
+
+    u64 calls;
+    u64 ticks;
+} Counter;
+
+typedef struct Context {
+    i64 interval;
+
+    // Open addressing, empty slots have no name
+    Counter counters[MAX_COUNTERS];
+
+    u32 numCounters;
+
+    // Ticks spent in nested scopes, subtracted from the enclosing scope
+    u64 childTicks[MAX_DEPTH];
+
+    int depth;
+
+    u64 start;
+} Context;
+
+#define ctx INSTANCE_CONTEXT(INSTANCE_STATS, Context)
+
+static u64 GetTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (u64)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static u32 HashCounter(const char* name, const u32 id) {
+    // FNV-1a
+    u32 hash = 0x811C9DC5 ^ id;
+
+    for (const char* c = name; *c != '\0'; c++) {
+        hash = (hash ^ (u8)*c) * 0x01000193;
+    }
+
+    return hash;
+}
+
+static Counter* GetCounter(const char* name, const u32 id) {
+    for (u32 slot = HashCounter(name, id) & (MAX_COUNTERS - 1);; slot = (slot + 1) & (MAX_COUNTERS - 1)) {
+        Counter* counter = &ctx.counters[slot];
+
+        if (counter->name == NULL) {
+            if (ctx.numCounters == (MAX_COUNTERS - 1)) {
+                printf("Stats Too many counters\n");
+                exit(1);
+            }
+
+            counter->name = strdup(name);
+            counter->id = id;
+
+            ctx.numCounters++;
+
+            return counter;
+        }
+
+        if ((counter->id == id) && (strcmp(counter->name, name) == 0)) {
+            return counter;
+        }
+    }
+}
+
+static void FreeCounters() {
+    for (u32 slot = 0; slot < MAX_COUNTERS; slot++) {
+        free(ctx.counters[slot].name);
+    }
+
+    memset(ctx.counters, 0, sizeof(ctx.counters));
+
+    ctx.numCounters = 0;
+}
+
+static int CompareCounters(const void* a, const void* b) {
+    const Counter* counterA = a;
+    const Counter* counterB = b;
+
+    if ((counterA->name == NULL) != (counterB->name == NULL)) {
+        // Empty slots go last
+        return (counterA->name == NULL) ? 1 : -1;
+    }
+
+    return (counterA->ticks < counterB->ticks) - (counterA->ticks > counterB->ticks);
+}
+
+static void Dump() {
+    const u64 end = GetTicks();
+
+    const u64 elapsed = end - ctx.start;
+
+    qsort(ctx.counters, MAX_COUNTERS, sizeof(Counter), CompareCounters);
+
+    printf("Stats %llu host ticks in %lld guest cycles\n", (unsigned long long)elapsed, (long long)ctx.interval);
+
+    for (u32 slot = 0; (slot < MAX_COUNTERS) && (ctx.counters[slot].name != NULL); slot++) {
+        const Counter* counter = &ctx.counters[slot];
+
+        printf("Stats %6.2f%% %14llu ticks %10llu calls  %s", 100.0 * counter->ticks / elapsed, (unsigned long long)counter->ticks, (unsigned long long)counter->calls, counter->name);
+
+        if (counter->id != 0) {
+            printf(" %X", counter->id);
+        }
+
+        putchar('\n');
+    }
+
+    FreeCounters();
+
+    ctx.start = end;
+}
+
+static void DumpEvent(const int) {
+    scheduler_ScheduleEvent("stats_Dump", DumpEvent, 0, ctx.interval);
+
+    Dump();
+}
+
+void stats_Initialize() {
+    instance_CreateContext(INSTANCE_STATS, sizeof(Context));
+}
+
+void stats_Reset() {
+    FreeCounters();
+
+    ctx.depth = 0;
+
+    if (ctx.interval == 0) {
+        return;
+    }
+
+    ctx.start = GetTicks();
+
+    scheduler_ScheduleEvent("stats_Dump", DumpEvent, 0, ctx.interval);
+}
+
+void stats_Shutdown() {
+    FreeCounters();
+
+    instance_DestroyContext(INSTANCE_STATS);
+}
+
+void stats_SetConfig(const i64 interval) {
+    assert(interval >= 0);
+
+    ctx.interval = interval;
+}
+
+stats_Scope stats_Begin() {
+    stats_Scope scope = {};
+
+    if ((ctx.interval == 0) || (ctx.depth == MAX_DEPTH)) {
+        return scope;
+    }
+
+    scope.depth = ctx.depth;
+
+    ctx.childTicks[ctx.depth++] = 0;
+
+    scope.start = GetTicks();
+
+    return scope;
+}
+
+void stats_End(const stats_Scope scope, const char* name, const u32 id) {
+    if (scope.start == 0) {
+        return;
+    }
+
+    const u64 elapsed = GetTicks() - scope.start;
+
+    // Also unwinds scopes left open by storage exceptions
+    ctx.depth = scope.depth;
+
+    if (ctx.depth != 0) {
+        ctx.childTicks[ctx.depth - 1] += elapsed;
+    }
+
+    Counter* counter = GetCounter(name, id);
+
+    counter->calls++;
+    counter->ticks += elapsed - ctx.childTicks[ctx.depth];
+}
@@ -0,0 +1,313 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/config.h"
+#include "common/types.h"
+
+#include "core/memory.h"
+
+#include "nouwii.h"
+
+#define NUM_ARGS (1 + 4)
+
+#define MAX_LINE     (256)
+#define MAX_LOG_PATH (4096)
+
+// Memory for the snapshots a job keeps to rewind to
+#define REWIND_BUDGET (64 * 1024 * 1024)
+
+typedef struct Job {
+    const char* pathScript;
+
+    pid_t pid;
+
+    struct timespec start;
+} Job;
+
+static u64 ParseNumber(const char* pathScript, const int line, const char* token) {
+    if (token == NULL) {
+        printf("Farm Missing argument (script: %s, line: %d)\n", pathScript, line);
+        exit(1);
+    }
+
+    char* end;
+
+    const u64 n = strtoull(token, &end, 0);
+
+    if (*end != '\0') {
+        printf("Farm Invalid number %s (script: %s, line: %d)\n", token, pathScript, line);
+        exit(1);
+    }
+
+    return n;
+}
+
+// Job scripts are lists of commands, one per line:
+//   run [cycles]
+//   write8/write16/write32 [physical address] [data]
+//   read8/read16/read32 [physical address]
+//   expect8/expect16/expect32 [physical address] [data]
+//   watch [physical address] [size] [r/w/rw]
+//   snapshot
+//   rewind (returns to the newest snapshot and discards it)
+static void RunScript(nouwii_Instance* instance, const char* pathScript) {
+    FILE* script = fopen(pathScript, "r");
+
+    if (script == NULL) {
+        printf("Farm Unable to open script %s\n", pathScript);
+        exit(1);
+    }
+
+    char buf[MAX_LINE];
+
+    for (int line = 1; fgets(buf, sizeof(buf), script) != NULL; line++) {
+        const char* cmd = strtok(buf, " \t\r\n");
+
+        if ((cmd == NULL) || (cmd[0] == '#')) {
+            continue;
+        }
+
+        if (strcmp(cmd, "run") == 0) {
+            nouwii_RunCycles(instance, ParseNumber(pathScript, line, strtok(NULL, " \t\r\n")));
+
+            continue;
+        }
+
+        if (strcmp(cmd, "snapshot") == 0) {
+            nouwii_Capture(instance);
+
+            continue;
+        }
+
+        if (strcmp(cmd, "rewind") == 0) {
+            if (!nouwii_StepBack(instance)) {
+                printf("Farm No snapshot to rewind to (script: %s, line: %d)\n", pathScript, line);
+                exit(1);
+            }
+
+            continue;
+        }
+
+        if (strcmp(cmd, "watch") == 0) {
+            const u32 addr = ParseNumber(pathScript, line, strtok(NULL, " \t\r\n"));
+            const u32 size = ParseNumber(pathScript, line, strtok(NULL, " \t\r\n"));
+
+            const char* type = strtok(NULL, " \t\r\n");
+
+            if ((type == NULL) || (strspn(type, "rw") != strlen(type)) || (size == 0)) {
+                printf("Farm Invalid watchpoint (script: %s, line: %d)\n", pathScript, line);
+                exit(1);
+            }
+
+            memory_AddWatchpoint(addr, size, ((strchr(type, 'r') != NULL) ? MEMORY_WATCH_READ : 0) | ((strchr(type, 'w') != NULL) ? MEMORY_WATCH_WRITE : 0));
+
+            continue;
+        }
+
+        int size;
+
+        if (sscanf(cmd, "%*[a-z]%d", &size) != 1) {
+            size = 0;
+        }
+
+        const u32 addr = ParseNumber(pathScript, line, strtok(NULL, " \t\r\n"));
+
+        u64 data = 0;
+
+        if (strncmp(cmd, "read", strlen("read")) != 0) {
+            data = ParseNumber(pathScript, line, strtok(NULL, " \t\r\n"));
+        }
+
+        if (strncmp(cmd, "write", strlen("write")) == 0) {
+            switch (size) {
+                case 8:
+                    memory_Write8(addr, data);
+                    break;
+                case 16:
+                    memory_Write16(addr, data);
+                    break;
+                case 32:
+                    memory_Write32(addr, data);
+                    break;
+                default:
+                    printf("Farm Invalid command %s (script: %s, line: %d)\n", cmd, pathScript, line);
+                    exit(1);
+            }
+
+            continue;
+        }
+
+        u32 value;
+
+        switch (size) {
+            case 8:
+                value = memory_Read8(addr);
+                break;
+            case 16:
+                value = memory_Read16(addr);
+                break;
+            case 32:
+                value = memory_Read32(addr);
+                break;
+            default:
+                printf("Farm Invalid command %s (script: %s, line: %d)\n", cmd, pathScript, line);
+                exit(1);
+        }
+
+        if (strncmp(cmd, "read", strlen("read")) == 0) {
+            printf("Farm %s %08X: %X\n", cmd, addr, value);
+        } else if (strncmp(cmd, "expect", strlen("expect")) == 0) {
+            if (value != data) {
+                printf("Farm Mismatch (script: %s, line: %d, address: %08X, expected: %llX, got: %X)\n", pathScript, line, addr, (unsigned long long)data, value);
+                exit(1);
+            }
+        } else {
+            printf("Farm Invalid command %s (script: %s, line: %d)\n", cmd, pathScript, line);
+            exit(1);
+        }
+    }
+
+    fclose(script);
+}
+
+static _Noreturn void RunJob(nouwii_Instance* instance, const char* pathScript) {
+    // Emulator output goes to a per-job log
+    char pathLog[MAX_LOG_PATH];
+
+    snprintf(pathLog, sizeof(pathLog), "%s.log", pathScript);
+
+    if (freopen(pathLog, "w", stdout) == NULL) {
+        exit(1);
+    }
+
+    RunScript(instance, pathScript);
+
+    fflush(stdout);
+
+    // The instance is a private copy, no need to shut it down
+    _exit(0);
+}
+
+static void ReportJob(const Job* job, const int status) {
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    const long ms = (end.tv_sec - job->start.tv_sec) * 1000 + (end.tv_nsec - job->start.tv_nsec) / 1000000;
+
+    if (WIFEXITED(status)) {
+        printf("%s: %s (exit code: %d, time: %ld ms)\n", job->pathScript, (WEXITSTATUS(status) == 0) ? "passed" : "failed", WEXITSTATUS(status), ms);
+    } else {
+        printf("%s: failed (signal: %d, time: %ld ms)\n", job->pathScript, WTERMSIG(status), ms);
+    }
+}
+
+// Waits for any job and returns its slot
+static int WaitJob(Job* jobs, const int numJobs, int* numFailed) {
+    int status;
+
+    const pid_t pid = wait(&status);
+
+    for (int i = 0; i < numJobs; i++) {
+        if (jobs[i].pid == pid) {
+            if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+                (*numFailed)++;
+            }
+
+            ReportJob(&jobs[i], status);
+
+            jobs[i].pid = 0;
+
+            return i;
+        }
+    }
+
+    printf("Farm Unknown child process %d\n", pid);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    if (argc < NUM_ARGS) {
+        puts("Usage: nouwii-farm [path to DOL] [boot cycles] [max workers] [job scripts...]");
+        return 1;
+    }
+
+    common_Config config = {};
+    config.pathDol = argv[1];
+    config.rewindBudget = REWIND_BUDGET;
+
+    const i64 bootCycles = strtoll(argv[2], NULL, 0);
+    const int maxWorkers = atoi(argv[3]);
+
+    if (maxWorkers <= 0) {
+        puts("Farm Invalid number of workers");
+        return 1;
+    }
+
+    // Boot once, all jobs start from the post-boot state
+    nouwii_Instance* instance = nouwii_Initialize(&config);
+
+    nouwii_Reset(instance);
+    nouwii_RunCycles(instance, bootCycles);
+
+    Job* jobs = calloc(maxWorkers, sizeof(Job));
+
+    int numRunning = 0;
+    int numFailed = 0;
+
+    for (int arg = NUM_ARGS - 1; arg < argc; arg++) {
+        int slot = 0;
+
+        if (numRunning == maxWorkers) {
+            slot = WaitJob(jobs, maxWorkers, &numFailed);
+
+            numRunning--;
+        } else {
+            while (jobs[slot].pid != 0) {
+                slot++;
+            }
+        }
+
+        Job* job = &jobs[slot];
+
+        job->pathScript = argv[arg];
+
+        clock_gettime(CLOCK_MONOTONIC, &job->start);
+
+        const pid_t pid = nouwii_Fork(instance);
+
+        if (pid < 0) {
+            puts("Farm Failed to fork worker");
+            return 1;
+        } else if (pid == 0) {
+            RunJob(instance, job->pathScript);
+        }
+
+        job->pid = pid;
+
+        numRunning++;
+    }
+
+    while (numRunning > 0) {
+        WaitJob(jobs, maxWorkers, &numFailed);
+
+        numRunning--;
+    }
+
+    printf("%d/%d jobs passed\n", argc - (NUM_ARGS - 1) - numFailed, argc - (NUM_ARGS - 1));
+
+    free(jobs);
+
+    nouwii_Shutdown(instance);
+
+    return (numFailed == 0) ? 0 : 1;
+}
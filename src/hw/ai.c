@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "core/instance.h"
+
 #define MAKEFUNC_AI_READIO(size)                                     \
 u##size ai_ReadIo##size(const u32 addr) {                            \
     printf("AI Unimplemented read%d (address: %08X)\n", size, addr); \
@@ -45,10 +47,10 @@ typedef struct Context {
     } control;
 } Context;
 
-static Context ctx;
+#define ctx INSTANCE_CONTEXT(INSTANCE_AI, Context)
 
 void ai_Initialize() {
-
+    instance_CreateContext(INSTANCE_AI, sizeof(Context));
 }
 
 void ai_Reset() {
@@ -56,7 +58,7 @@ void ai_Reset() {
 }
 
 void ai_Shutdown() {
-
+    instance_DestroyContext(INSTANCE_AI);
 }
 
 MAKEFUNC_AI_READIO(8)
@@ -7,20 +7,28 @@
 
 #include <assert.h>
 #include <math.h>
+#include <setjmp.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "common/bit.h"
+#include "common/bswap.h"
 #include "common/types.h"
 
+#include "core/codecache.h"
+#include "core/coverage.h"
+#include "core/instance.h"
 #include "core/memory.h"
+#include "core/scheduler.h"
 
 #include "hw/pi.h"
 
 // #define BROADWAY_DEBUG
 // #define BROADWAY_DEBUG_FLOATS
+// #define BROADWAY_VERIFY_FUSION
 
 #define NUM_GPRS  (32)
 #define NUM_FPRS  (32)
@@ -30,15 +38,37 @@
 #define NUM_PMCS  (4)
 #define NUM_SPRGS (4)
 #define NUM_PS    (2)
+#define NUM_SRS   (16)
+
+// Same geometry as the 750CL ITLB/DTLB, 128 entries each
+#define NUM_TLB_SETS (64)
+#define NUM_TLB_WAYS (2)
+
+#define SIZE_PAGE (0x1000)
+
+// BAT length field of a block covering a whole segment (256 MiB)
+#define BL_SEGMENT (0x7FF)
 
 #define SIZE_CACHE_BLOCK (0x20)
 
+// lswi/stswi transfer at most 32 bytes
+#define MAX_STRING_BYTES (32)
+
+#define BASE_LOCKED_CACHE (0xE0000000)
+#define SIZE_LOCKED_CACHE (0x4000)
+
+// Locked cache DMA, HID2.DMAQL is 4 bits wide
+#define MAX_CACHE_DMAS (15)
+#define NUM_CACHE_DMA_CYCLES_PER_BLOCK (24)
+
 #define INITIAL_PC (0x3400)
 
 #define MASK_MSR  (0x87C0FF73)
 #define MASK_SRR1 (0x783F0000)
 
 enum {
+    VECTOR_DSI                = 0x300,
+    VECTOR_ISI                = 0x400,
     VECTOR_EXTERNAL_INTERRUPT = 0x500,
     VECTOR_SYSTEM_CALL        = 0xC00,
 };
@@ -89,60 +119,77 @@ enum {
 };
 
 enum {
-    SECONDARY_CMP    =    0,
-    SECONDARY_SUBFC  =    8,
-    SECONDARY_ADDC   =   10,
-    SECONDARY_MULHWU =   11,
-    SECONDARY_MFCR   =   19,
-    SECONDARY_LWZX   =   23,
-    SECONDARY_SLW    =   24,
-    SECONDARY_CNTLZW =   26,
-    SECONDARY_AND    =   28,
-    SECONDARY_CMPL   =   32,
-    SECONDARY_SUBF   =   40,
-    SECONDARY_LWZUX  =   55,
-    SECONDARY_ANDC   =   60,
-    SECONDARY_MULHW  =   75,
-    SECONDARY_MFMSR  =   83,
-    SECONDARY_DCBF   =   86,
-    SECONDARY_LBZX   =   87,
-    SECONDARY_NEG    =  104,
-    SECONDARY_NOR    =  124,
-    SECONDARY_SUBFE  =  136,
-    SECONDARY_ADDE   =  138,
-    SECONDARY_MTCR   =  144,
-    SECONDARY_MTMSR  =  146,
-    SECONDARY_STWX   =  151,
-    SECONDARY_STWUX  =  183,
-    SECONDARY_SUBFZE =  200,
-    SECONDARY_ADDZE  =  202,
-    SECONDARY_MTSR   =  210,
-    SECONDARY_STBX   =  215,
-    SECONDARY_MULLW  =  235,
-    SECONDARY_ADD    =  266,
-    SECONDARY_LHZX   =  279,
-    SECONDARY_XOR    =  316,
-    SECONDARY_MFSPR  =  339,
-    SECONDARY_MFTB   =  371,
-    SECONDARY_STHX   =  407,
-    SECONDARY_ORC    =  412,
-    SECONDARY_OR     =  444,
-    SECONDARY_DIVWU  =  459,
-    SECONDARY_MTSPR  =  467,
-    SECONDARY_DCBI   =  470,
-    SECONDARY_DIVW   =  491,
-    SECONDARY_SRW    =  536,
-    SECONDARY_LSWI   =  597,
-    SECONDARY_SYNC   =  598,
-    SECONDARY_LFDX   =  599,
-    SECONDARY_STSWI  =  725,
-    SECONDARY_SRAW   =  792,
-    SECONDARY_SRAWI  =  824,
-    SECONDARY_EXTSH  =  922,
-    SECONDARY_EXTSB  =  954,
-    SECONDARY_ICBI   =  982,
-    SECONDARY_STFIWX =  983,
-    SECONDARY_DCBZ   = 1014,
+    SECONDARY_CMP     =    0,
+    SECONDARY_SUBFC   =    8,
+    SECONDARY_ADDC    =   10,
+    SECONDARY_MULHWU  =   11,
+    SECONDARY_MFCR    =   19,
+    SECONDARY_LWZX    =   23,
+    SECONDARY_SLW     =   24,
+    SECONDARY_CNTLZW  =   26,
+    SECONDARY_AND     =   28,
+    SECONDARY_CMPL    =   32,
+    SECONDARY_SUBF    =   40,
+    SECONDARY_LWZUX   =   55,
+    SECONDARY_ANDC    =   60,
+    SECONDARY_MULHW   =   75,
+    SECONDARY_MFMSR   =   83,
+    SECONDARY_DCBF    =   86,
+    SECONDARY_LBZX    =   87,
+    SECONDARY_NEG     =  104,
+    SECONDARY_NOR     =  124,
+    SECONDARY_SUBFE   =  136,
+    SECONDARY_ADDE    =  138,
+    SECONDARY_MTCR    =  144,
+    SECONDARY_MTMSR   =  146,
+    SECONDARY_STWX    =  151,
+    SECONDARY_STWUX   =  183,
+    SECONDARY_SUBFZE  =  200,
+    SECONDARY_ADDZE   =  202,
+    SECONDARY_MTSR    =  210,
+    SECONDARY_MTSRIN  =  242,
+    SECONDARY_STBX    =  215,
+    SECONDARY_MULLW   =  235,
+    SECONDARY_ADD     =  266,
+    SECONDARY_LHZX    =  279,
+    SECONDARY_TLBIE   =  306,
+    SECONDARY_XOR     =  316,
+    SECONDARY_MFSPR   =  339,
+    SECONDARY_MFTB    =  371,
+    SECONDARY_STHX    =  407,
+    SECONDARY_ORC     =  412,
+    SECONDARY_OR      =  444,
+    SECONDARY_DIVWU   =  459,
+    SECONDARY_MTSPR   =  467,
+    SECONDARY_DCBI    =  470,
+    SECONDARY_DIVW    =  491,
+    SECONDARY_SUBFCO  =  520,
+    SECONDARY_ADDCO   =  522,
+    SECONDARY_SRW     =  536,
+    SECONDARY_SUBFO   =  552,
+    SECONDARY_TLBSYNC =  566,
+    SECONDARY_MFSR    =  595,
+    SECONDARY_LSWI    =  597,
+    SECONDARY_SYNC    =  598,
+    SECONDARY_LFDX    =  599,
+    SECONDARY_NEGO    =  616,
+    SECONDARY_SUBFEO  =  648,
+    SECONDARY_ADDEO   =  650,
+    SECONDARY_MFSRIN  =  659,
+    SECONDARY_SUBFZEO =  712,
+    SECONDARY_ADDZEO  =  714,
+    SECONDARY_STSWI   =  725,
+    SECONDARY_MULLWO  =  747,
+    SECONDARY_ADDO    =  778,
+    SECONDARY_SRAW    =  792,
+    SECONDARY_SRAWI   =  824,
+    SECONDARY_EXTSH   =  922,
+    SECONDARY_EXTSB   =  954,
+    SECONDARY_DIVWUO  =  971,
+    SECONDARY_ICBI    =  982,
+    SECONDARY_STFIWX  =  983,
+    SECONDARY_DIVWO   = 1003,
+    SECONDARY_DCBZ    = 1014,
 };
 
 enum {
@@ -160,6 +207,7 @@ enum {
     PAIREDSINGLE_PSMR      =  72,
     PAIREDSINGLE_PSMERGE01 = 560,
     PAIREDSINGLE_PSMERGE10 = 592,
+    PAIREDSINGLE_DCBZL     = 1014,
 };
 
 enum {
@@ -181,8 +229,10 @@ enum {
     SPR_XER    =    1,
     SPR_LR     =    8,
     SPR_CTR    =    9,
+    SPR_DSISR  =   18,
     SPR_DAR    =   19,
     SPR_DEC    =   22,
+    SPR_SDR1   =   25,
     SPR_SRR0   =   26,
     SPR_SRR1   =   27,
     SPR_TBL    =  268,
@@ -200,6 +250,8 @@ enum {
     SPR_GQR0   =  912,
     SPR_GQR7   =  919,
     SPR_HID2   =  920,
+    SPR_DMAU   =  922,
+    SPR_DMAL   =  923,
     SPR_MMCR0  =  952,
     SPR_PMC1   =  953,
     SPR_PMC2   =  954,
@@ -223,14 +275,41 @@ enum {
     QUANT_TYPE_FLOAT = 0,
 };
 
+enum {
+    ACCESS_READ,
+    ACCESS_WRITE,
+    ACCESS_CODE,
+};
+
+// Segment map entries, the physical base of a BAT-mapped segment is OR'd with SEGMENT_BAT
+enum {
+    SEGMENT_SEARCH = 0,      // Partially covered by BATs, search them
+    SEGMENT_BAT    = 1 << 0, // Covered by a single BAT
+    SEGMENT_PAGED  = 1 << 1, // Not covered by any BAT
+};
+
+// DSISR and SRR1 status bits for storage exceptions
+enum {
+    FAULT_STORE      = 1 << 25,
+    FAULT_PROTECTION = 1 << 27,
+    FAULT_NO_EXECUTE = 1 << 28,
+    FAULT_NOT_FOUND  = 1 << 30,
+};
+
 #define MAKEFUNC_BROADWAY_READ(size)                        \
 static u##size Read##size(const u32 addr, const int code) { \
-    return memory_Read##size(Translate(addr, code));        \
+    ctx.access.addr = addr;                                 \
+    ctx.access.type = (code) ? ACCESS_CODE : ACCESS_READ;   \
+                                                            \
+    return memory_Read##size(Translate(addr, ctx.access.type)); \
 }                                                           \
 
 #define MAKEFUNC_BROADWAY_WRITE(size)                         \
 static void Write##size(const u32 addr, const u##size data) { \
-    memory_Write##size(Translate(addr, NOUWII_FALSE), data);  \
+    ctx.access.addr = addr;                                   \
+    ctx.access.type = ACCESS_WRITE;                           \
+                                                              \
+    memory_Write##size(Translate(addr, ACCESS_WRITE), data);  \
 }                                                             \
 
 #define TO_IBM_POS(n) (31 - n)
@@ -277,6 +356,7 @@ static u32 SetBits(const u32 n, const u32 start, const u32 end, const u32 data)
 #define    W (GetBits(instr, 16, 16) != 0)
 #define    L (GetBits(instr, 10, 10) != 0)
 #define   AA (GetBits(instr, 30, 30) != 0)
+#define   OE (GetBits(instr, 21, 21) != 0)
 #define   RC (GetBits(instr, 31, 31) != 0)
 #define   LK (GetBits(instr, 31, 31) != 0)
 #define UIMM (GetBits(instr, 16, 31))
@@ -299,6 +379,9 @@ static u32 SetBits(const u32 n, const u32 start, const u32 end, const u32 data)
 #define   CTR (ctx.sprs.ctr)
 #define    LR (ctx.sprs.lr)
 #define   DAR (ctx.sprs.dar)
+#define DSISR (ctx.sprs.dsisr)
+#define  SDR1 (ctx.sprs.sdr1)
+#define    SR (ctx.sprs.sr)
 #define   DEC (ctx.sprs.dec)
 #define   TBR (ctx.sprs.tbr.raw)
 #define   TBL (ctx.sprs.tbr.tbl)
@@ -306,6 +389,8 @@ static u32 SetBits(const u32 n, const u32 start, const u32 end, const u32 data)
 #define  HID0 (ctx.sprs.hid0)
 #define  HID2 (ctx.sprs.hid2)
 #define  HID4 (ctx.sprs.hid4)
+#define  DMAU (ctx.sprs.dmau)
+#define  DMAL (ctx.sprs.dmal)
 #define MMCR0 (ctx.sprs.mmcr0)
 #define MMCR1 (ctx.sprs.mmcr1)
 #define   PMC (ctx.sprs.pmc)
@@ -382,6 +467,97 @@ typedef union Batu {
     };
 } Batu;
 
+typedef union Sdr1 {
+    u32 raw;
+
+    struct {
+        u32 htabmask :  9; // Hash table mask
+        u32          :  7;
+        u32  htaborg : 16; // Hash table origin
+    };
+} Sdr1;
+
+typedef union Sr {
+    u32 raw;
+
+    struct {
+        u32 vsid : 24; // Virtual segment ID
+        u32      :  4;
+        u32    n :  1; // No-execute
+        u32   kp :  1; // User key
+        u32   ks :  1; // Supervisor key
+        u32    t :  1; // Direct-store segment
+    };
+} Sr;
+
+typedef union Pte {
+    u64 raw;
+
+    struct {
+        // Second word
+        u32   pp :  2; // Page protection
+        u32      :  1;
+        u32 wimg :  4; // Storage access control
+        u32    c :  1; // Changed
+        u32    r :  1; // Referenced
+        u32      :  3;
+        u32  rpn : 20; // Real page number
+
+        // First word
+        u32  api :  6; // Abbreviated page index
+        u32    h :  1; // Hash function
+        u32 vsid : 24; // Virtual segment ID
+        u32    v :  1; // Valid
+    };
+} Pte;
+
+typedef struct TlbEntry {
+    u32 page; // Effective page number
+    u32 vsid;
+    u32 rpn;
+    u32 pteAddr;
+
+    u8 valid;
+    u8 pp;
+    u8 c;
+} TlbEntry;
+
+typedef struct Tlb {
+    TlbEntry entries[NUM_TLB_SETS][NUM_TLB_WAYS];
+
+    // Next way to replace
+    u8 lru[NUM_TLB_SETS];
+} Tlb;
+
+typedef union Dmau {
+    u32 raw;
+
+    struct {
+        u32    lenU :  5; // Transfer length (upper bits)
+        u32 memAddr : 27; // Main memory address
+    };
+} Dmau;
+
+typedef union Dmal {
+    u32 raw;
+
+    struct {
+        u32      f :  1; // Flush
+        u32      t :  1; // Trigger
+        u32   lenL :  2; // Transfer length (lower bits)
+        u32     ld :  1; // Load (main memory -> locked cache)
+        u32 lcAddr : 27; // Locked cache address
+    };
+} Dmal;
+
+typedef struct CacheDma {
+    u32 memAddr;
+    u32 lcAddr;
+    u32 size;
+
+    int load;
+} CacheDma;
+
 typedef union Counter {
     u32 raw;
 
@@ -564,6 +740,14 @@ typedef struct SpecialRegs {
     u32 sprg[NUM_SPRGS];
 
     u32 dar;
+    u32 dsisr;
+
+    Dmau dmau;
+    Dmal dmal;
+
+    Sdr1 sdr1;
+
+    Sr sr[NUM_SRS];
 
     u32 lr;
     u32 ctr;
@@ -586,9 +770,65 @@ typedef struct Context {
     SpecialRegs sprs;
 
     Msr msr;
+
+    Tlb itlb, dtlb;
+
+    // BAT translation of each segment, indexed by [code][MSR.pr][segment]
+    u32 segments[2][2][NUM_SRS];
+
+    // Locked cache and its DMA queue
+    u8 lockedCache[SIZE_LOCKED_CACHE];
+
+    CacheDma dmas[MAX_CACHE_DMAS];
+
+    u32 numDmas;
+
+    // Bumped by queue flushes, completion events of flushed transfers carry an older one
+    int dmaGen;
+
+    // Current guest access, for faults reported by the memory layer
+    struct {
+        u32 addr;
+        int type;
+    } access;
+
+    // Storage exceptions unwind to broadway_Run
+    jmp_buf fault;
+
+    // Time base prescaler
+    int prescaler;
+
+    // Set when an interrupt may have become deliverable, checked between blocks
+    atomic_int interruptPending;
+
+    // Host state of lockstep mode, NULL if it's off
+    struct Lockstep* lockstep;
 } Context;
 
-static Context ctx;
+#define ctx INSTANCE_CONTEXT(INSTANCE_BROADWAY, Context)
+
+// Every compiled block is checked against the interpreter. The block runs first,
+// then RAM and the context are rolled back and the interpreter runs the same
+// number of instructions. Blocks that access I/O can't be repeated and are skipped
+typedef struct Lockstep {
+    // RAM as of the start of the current block
+    u8* shadow;
+
+    // RAM pages written by the block, set aside while the interpreter runs
+    u8* result;
+
+    u64 dirtyBlock[MEMORY_SIZE_DIRTY_BITMAP];
+    u64 dirtyInterpreter[MEMORY_SIZE_DIRTY_BITMAP];
+
+    // Shadow is only valid after the first full copy
+    int synced;
+
+    Context saved;
+    Context block;
+
+    u64 numChecked;
+    u64 numSkipped;
+} Lockstep;
 
 static void SaveExceptionContext() {
     // Save IA and MSR
@@ -608,6 +848,9 @@ static void SaveExceptionContext() {
     MSR.pr  = 0;
     MSR.ee  = 0;
     MSR.pow = 0;
+
+    // Instruction translation is now off
+    codecache_Unlink();
 }
 
 static void ExternalInterrupt() {
@@ -618,6 +861,31 @@ static void ExternalInterrupt() {
     IA = VECTOR_EXTERNAL_INTERRUPT;
 }
 
+static void DataStorageInterrupt(const u32 addr, const u32 status) {
+    printf("Broadway DSI exception (CIA: %08X, address: %08X, DSISR: %08X)\n", CIA, addr, status);
+
+    // The faulting instruction is restarted
+    IA = CIA;
+
+    SaveExceptionContext();
+
+    DAR = addr;
+    DSISR = status;
+
+    IA = VECTOR_DSI;
+}
+
+static void InstructionStorageInterrupt(const u32 status) {
+    printf("Broadway ISI exception (IA: %08X, SRR1: %08X)\n", IA, status);
+
+    // IA still holds the address that couldn't be fetched
+    SaveExceptionContext();
+
+    SRR1.raw |= status;
+
+    IA = VECTOR_ISI;
+}
+
 static void SystemCall() {
     printf("Broadway System call exception (CIA: %08X)\n", CIA);
 
@@ -627,6 +895,19 @@ static void SystemCall() {
 }
 
 static void CheckInterrupt() {
+    // Delivered by the dispatcher once the current block ends
+    if (MSR.ee != 0) {
+        atomic_store_explicit(&ctx.interruptPending, NOUWII_TRUE, memory_order_relaxed);
+    }
+}
+
+static int IsInterruptPending() {
+    return atomic_load_explicit(&ctx.interruptPending, memory_order_relaxed);
+}
+
+static void DeliverInterrupt() {
+    atomic_store_explicit(&ctx.interruptPending, NOUWII_FALSE, memory_order_relaxed);
+
     if (pi_IsIrqAsserted() && (MSR.ee != 0)) {
         ExternalInterrupt();
     }
@@ -653,11 +934,225 @@ static void SetFlags(const int cr, const u32 n) {
     SetCr(cr, (lt << COND_LT) | (gt << COND_GT) | (eq << COND_EQ) | so);
 }
 
-static u32 Translate(const u32 addr, const int code) {
+// OE forms record signed overflow in OV and make it sticky in SO, before Rc copies SO to CR0
+static void SetOverflow(const u32 instr, const u32 ov) {
+    if (!OE) {
+        return;
+    }
+
+    XER.ov = ov;
+    XER.so |= ov;
+}
+
+// Signed overflow of a + b (+ carry) with the 32-bit result n
+static u32 AddOverflows(const u32 a, const u32 b, const u32 n) {
+    return ((a ^ n) & (b ^ n)) >> 31;
+}
+
+// Single delivery path for storage exceptions, whether raised by translation or by the memory layer
+static _Noreturn void StorageFault(const u32 addr, const int access, const u32 status) {
+    if (access == ACCESS_CODE) {
+        InstructionStorageInterrupt(status);
+    } else {
+        DataStorageInterrupt(addr, (access == ACCESS_WRITE) ? (status | FAULT_STORE) : status);
+    }
+
+    // Abort the faulting instruction
+    longjmp(ctx.fault, 1);
+}
+
+static void MemoryFault(const u32 addr, const int write) {
+    (void)addr;
+    (void)write;
+
+    // Broadway would take a machine check, report it as a missing translation instead
+    StorageFault(ctx.access.addr, ctx.access.type, FAULT_NOT_FOUND);
+}
+
+static void MemoryWatch(const u32 addr, const u32 size, const u64 data, const int write) {
+    if (ctx.access.type == ACCESS_CODE) {
+        // Data watchpoints only
+        return;
+    }
+
+    printf("Broadway Watchpoint hit (CIA: %08X, address: %08X, physical address: %08X, %s%u, data: %llX)\n", CIA, ctx.access.addr, addr, (write) ? "write" : "read", 8 * size, (unsigned long long)data);
+}
+
+static void InvalidateTlbSet(const u32 addr) {
+    // tlbie invalidates the whole congruence class in both TLBs
+    const u32 set = (addr / SIZE_PAGE) & (NUM_TLB_SETS - 1);
+
+    memset(ctx.itlb.entries[set], 0, sizeof(ctx.itlb.entries[set]));
+    memset(ctx.dtlb.entries[set], 0, sizeof(ctx.dtlb.entries[set]));
+}
+
+static TlbEntry* SearchPageTable(Tlb* tlb, const u32 addr, const Sr sr) {
+    // https://www.nxp.com/docs/en/reference-manual/MPCFPE32B.pdf, chapter 7.6
+    const u32 pageIndex = (addr / SIZE_PAGE) & 0xFFFF;
+    const u32 hashMask = (SDR1.htabmask << 10) | 0x3FF;
+
+    u32 hash = (sr.vsid & 0x7FFFF) ^ pageIndex;
+
+    for (u32 h = 0; h < 2; h++) {
+        const u32 pteg = (SDR1.raw & 0xFFFF0000) | ((hash & hashMask) << 6);
+
+        for (u32 i = 0; i < 8; i++) {
+            const u32 pteAddr = pteg + i * sizeof(u64);
+
+            Pte pte;
+            pte.raw = memory_Read64(pteAddr);
+
+            if ((pte.v == 0) || (pte.h != h) || (pte.vsid != sr.vsid) || (pte.api != (pageIndex >> 10))) {
+                continue;
+            }
+
+            if (pte.r == 0) {
+                pte.r = 1;
+
+                memory_Write32(pteAddr + sizeof(u32), (u32)pte.raw);
+            }
+
+            const u32 set = (addr / SIZE_PAGE) & (NUM_TLB_SETS - 1);
+            const u32 way = tlb->lru[set];
+
+            TlbEntry* entry = &tlb->entries[set][way];
+
+            entry->page = addr / SIZE_PAGE;
+            entry->vsid = sr.vsid;
+            entry->rpn = pte.rpn * SIZE_PAGE;
+            entry->pteAddr = pteAddr;
+            entry->valid = NOUWII_TRUE;
+            entry->pp = pte.pp;
+            entry->c = pte.c;
+
+            tlb->lru[set] = way ^ 1;
+
+            return entry;
+        }
+
+        hash = ~hash;
+    }
+
+    return NULL;
+}
+
+static u32 TranslatePage(const u32 addr, const int access) {
+    const Sr sr = SR[addr >> 28];
+
+    if (sr.t != 0) {
+        // Direct-store segments aren't supported by Broadway
+        StorageFault(addr, access, (access == ACCESS_CODE) ? FAULT_NO_EXECUTE : FAULT_NOT_FOUND);
+    }
+
+    if ((access == ACCESS_CODE) && (sr.n != 0)) {
+        StorageFault(addr, access, FAULT_NO_EXECUTE);
+    }
+
+    Tlb* tlb = (access == ACCESS_CODE) ? &ctx.itlb : &ctx.dtlb;
+
+    const u32 page = addr / SIZE_PAGE;
+    const u32 set = page & (NUM_TLB_SETS - 1);
+
+    TlbEntry* entry = NULL;
+
+    for (u32 way = 0; way < NUM_TLB_WAYS; way++) {
+        TlbEntry* e = &tlb->entries[set][way];
+
+        if (e->valid && (e->page == page) && (e->vsid == sr.vsid)) {
+            entry = e;
+
+            tlb->lru[set] = way ^ 1;
+            break;
+        }
+    }
+
+    if (entry == NULL) {
+        entry = SearchPageTable(tlb, addr, sr);
+
+        if (entry == NULL) {
+            StorageFault(addr, access, FAULT_NOT_FOUND);
+        }
+    }
+
+    const int key = (MSR.pr != 0) ? sr.kp : sr.ks;
+
+    if (access == ACCESS_WRITE) {
+        if ((key && (entry->pp != 2)) || (!key && (entry->pp == 3))) {
+            StorageFault(addr, access, FAULT_PROTECTION);
+        }
+
+        if (entry->c == 0) {
+            // First store to this page through the TLB entry
+            const u32 lo = memory_Read32(entry->pteAddr + sizeof(u32));
+
+            memory_Write32(entry->pteAddr + sizeof(u32), lo | (1 << 7));
+
+            entry->c = 1;
+        }
+    } else if (key && (entry->pp == 0)) {
+        StorageFault(addr, access, FAULT_PROTECTION);
+    }
+
+    return entry->rpn | (addr & (SIZE_PAGE - 1));
+}
+
+static void UpdateSegments() {
+    // Cached and uncached windows are usually one BAT per segment each,
+    // the segment map lets accesses to them skip the BAT search
+    for (int code = 0; code < 2; code++) {
+        const Batl* batl = (code) ? IBATL : DBATL;
+        const Batu* batu = (code) ? IBATU : DBATU;
+
+        for (int pr = 0; pr < 2; pr++) {
+            for (u32 segment = 0; segment < NUM_SRS; segment++) {
+                u32 entry = SEGMENT_PAGED;
+
+                // The first BAT in this segment decides, same as in the search
+                for (int i = 0; i < (4 + 4 * HID4.sbe); i++) {
+                    if (((pr) ? batu[i].vp : batu[i].vs) == 0) {
+                        continue;
+                    }
+
+                    const u32 bepi = batu[i].bepi << 17;
+                    const u32 length = batu[i].bl << 17;
+
+                    if (((bepi >> 28) != segment) || ((bepi & length) != 0)) {
+                        // Never hits in this segment
+                        continue;
+                    }
+
+                    if (batu[i].bl == BL_SEGMENT) {
+                        entry = (batl[i].brpn << 17) | SEGMENT_BAT;
+                    } else {
+                        entry = SEGMENT_SEARCH;
+                    }
+
+                    break;
+                }
+
+                ctx.segments[code][pr][segment] = entry;
+            }
+        }
+    }
+}
+
+static u32 Translate(const u32 addr, const int access) {
+    const int code = access == ACCESS_CODE;
+
     if (!((code && (MSR.ir != 0)) || (!code && (MSR.dr != 0)))) {
         return addr;
     }
 
+    const u32 segment = ctx.segments[code][MSR.pr][addr >> 28];
+
+    if ((segment & SEGMENT_BAT) != 0) {
+        return (segment & ~SEGMENT_BAT) | (addr & ~0xF0000000);
+    }
+
+    if ((segment & SEGMENT_PAGED) != 0) {
+        return TranslatePage(addr, access);
+    }
+
     // https://mariokartwii.com/showthread.php?tid=1963
 
     const Batl* batl = DBATL;
@@ -670,6 +1165,10 @@ static u32 Translate(const u32 addr, const int code) {
 
     // Number of enabled BATs depends on HID4
     for (int i = 0; i < (4 + 4 * HID4.sbe); i++) {
+        if (((MSR.pr != 0) ? batu[i].vp : batu[i].vs) == 0) {
+            continue;
+        }
+
         const u32 length = batu[i].bl << 17;
 
         const u32 index = ADDR_SEGMENT | (ADDR_PAGE & ~length);
@@ -680,9 +1179,7 @@ static u32 Translate(const u32 addr, const int code) {
         }
     }
 
-    printf("BAT miss (address: %08X)\n", addr);
-
-    exit(1);
+    return TranslatePage(addr, access);
 }
 
 MAKEFUNC_BROADWAY_READ(8)
@@ -705,6 +1202,106 @@ MAKEFUNC_BROADWAY_WRITE(16)
 MAKEFUNC_BROADWAY_WRITE(32)
 MAKEFUNC_BROADWAY_WRITE(64)
 
+static u8* GetSpan(const u32 addr, const u32 size, const int access) {
+    // Host pointer for a range covered by a single translation, NULL if it needs per-element accesses
+    if (((addr & (SIZE_PAGE - 1)) + size) > SIZE_PAGE) {
+        return NULL;
+    }
+
+    return memory_GetSpan(Translate(addr, access), size, access == ACCESS_WRITE);
+}
+
+static void SetLockedCache(const int enable) {
+    if (enable) {
+        printf("HID2 Locked cache enabled\n");
+
+        memory_Map(ctx.lockedCache, BASE_LOCKED_CACHE, SIZE_LOCKED_CACHE, NOUWII_TRUE, NOUWII_TRUE);
+    } else {
+        printf("HID2 Locked cache disabled\n");
+
+        memory_Unmap(BASE_LOCKED_CACHE, SIZE_LOCKED_CACHE);
+    }
+}
+
+static void TransferDma(const CacheDma* dma) {
+    const u32 offset = dma->lcAddr & (SIZE_LOCKED_CACHE - 1);
+
+    u32 size = dma->size;
+
+    if ((offset + size) > SIZE_LOCKED_CACHE) {
+        // Blocks past the end of the locked cache miss, only the ones before it are transferred
+        printf("Broadway Locked cache DMA past the end of the locked cache (cache: %08X, size: %u)\n", dma->lcAddr, dma->size);
+
+        HID2.dcmerr = 1;
+
+        size = SIZE_LOCKED_CACHE - offset;
+    }
+
+    if (dma->load) {
+        memory_CopyFromGuest(&ctx.lockedCache[offset], dma->memAddr, size);
+    } else {
+        memory_CopyToGuest(dma->memAddr, &ctx.lockedCache[offset], size);
+    }
+}
+
+static void ScheduleDma() {
+    const u32 numBlocks = ctx.dmas[0].size / SIZE_CACHE_BLOCK;
+
+    scheduler_ScheduleEvent("broadway_CompleteDma", broadway_CompleteDma, ctx.dmaGen, NUM_CACHE_DMA_CYCLES_PER_BLOCK * numBlocks);
+}
+
+static void QueueDma() {
+    if (ctx.numDmas == MAX_CACHE_DMAS) {
+        printf("Broadway Locked cache DMA queue overflow\n");
+
+        HID2.dqoerr = 1;
+
+        return;
+    }
+
+    u32 numBlocks = (DMAU.lenU << 2) | DMAL.lenL;
+
+    if (numBlocks == 0) {
+        numBlocks = 128;
+    }
+
+    CacheDma* dma = &ctx.dmas[ctx.numDmas++];
+
+    dma->memAddr = DMAU.memAddr * SIZE_CACHE_BLOCK;
+    dma->lcAddr = DMAL.lcAddr * SIZE_CACHE_BLOCK;
+    dma->size = numBlocks * SIZE_CACHE_BLOCK;
+    dma->load = DMAL.ld;
+
+    printf("Broadway Locked cache DMA (%s, memory: %08X, cache: %08X, size: %u)\n", (dma->load) ? "load" : "store", dma->memAddr, dma->lcAddr, dma->size);
+
+    HID2.dmaql = ctx.numDmas;
+
+    if (ctx.numDmas == 1) {
+        ScheduleDma();
+    }
+}
+
+void broadway_CompleteDma(const int gen) {
+    if (gen != ctx.dmaGen) {
+        // Transfer was flushed, the queue may already hold new ones with their own event
+        return;
+    }
+
+    TransferDma(&ctx.dmas[0]);
+
+    ctx.numDmas--;
+
+    memmove(&ctx.dmas[0], &ctx.dmas[1], ctx.numDmas * sizeof(CacheDma));
+
+    HID2.dmaql = ctx.numDmas;
+
+    if (ctx.numDmas != 0) {
+        ScheduleDma();
+    } else {
+        DMAL.t = 0;
+    }
+}
+
 static u32 GetSpr(const u32 spr) {
     if ((spr >= SPR_SPRG0) && (spr <= SPR_SPRG3)) {
         const u32 idx = spr - SPR_SPRG0;
@@ -735,6 +1332,10 @@ static u32 GetSpr(const u32 spr) {
             printf("CTR read\n");
 
             return CTR;
+        case SPR_DSISR:
+            printf("DSISR read\n");
+
+            return DSISR;
         case SPR_DAR:
             printf("DAR read\n");
 
@@ -743,6 +1344,10 @@ static u32 GetSpr(const u32 spr) {
             printf("DEC read\n");
 
             return DEC.raw;
+        case SPR_SDR1:
+            printf("SDR1 read\n");
+
+            return SDR1.raw;
         case SPR_SRR0:
             printf("SRR0 read\n");
 
@@ -763,6 +1368,14 @@ static u32 GetSpr(const u32 spr) {
             printf("HID2 read\n");
 
             return HID2.raw;
+        case SPR_DMAU:
+            printf("DMAU read\n");
+
+            return DMAU.raw;
+        case SPR_DMAL:
+            printf("DMAL read\n");
+
+            return DMAL.raw;
         case SPR_MMCR0:
             printf("MMCR0 read\n");
 
@@ -836,6 +1449,10 @@ static void SetSpr(const u32 spr, const u32 data) {
             IBATU[idx].raw = data;
         }
 
+        UpdateSegments();
+
+        codecache_Unlink();
+
         return;
     }
 
@@ -857,6 +1474,8 @@ static void SetSpr(const u32 spr, const u32 data) {
             DBATU[idx].raw = data;
         }
 
+        UpdateSegments();
+
         return;
     }
 
@@ -886,6 +1505,11 @@ static void SetSpr(const u32 spr, const u32 data) {
 
             CTR = data;
             break;
+        case SPR_DSISR:
+            printf("DSISR write (data: %08X)\n", data);
+
+            DSISR = data;
+            break;
         case SPR_DAR:
             printf("DAR write (data: %08X)\n", data);
 
@@ -898,6 +1522,11 @@ static void SetSpr(const u32 spr, const u32 data) {
 
             DEC.raw = data;
             break;
+        case SPR_SDR1:
+            printf("SDR1 write (data: %08X)\n", data);
+
+            SDR1.raw = data;
+            break;
         case SPR_SRR0:
             printf("SRR0 write (data: %08X)\n", data);
 
@@ -909,26 +1538,61 @@ static void SetSpr(const u32 spr, const u32 data) {
             SRR1.raw = data;
             break;
         case SPR_HID2:
-            printf("HID2 write (data: %08X)\n", data);
+            {
+                printf("HID2 write (data: %08X)\n", data);
 
-            HID2.raw = data;
+                const u32 lce = HID2.lce;
 
-            if (HID2.pse != 0) {
-                printf("HID2 Paired Singles enabled\n");
-            }
+                HID2.raw = data;
 
-            if (HID2.wpe != 0) {
-                printf("HID2 Write-gather pipe enabled\n");
-            }
+                // Read-only
+                HID2.dmaql = ctx.numDmas;
 
-            if (HID2.lsqe != 0) {
-                printf("HID2 Quantized loadstores enabled\n");
+                if (HID2.pse != 0) {
+                    printf("HID2 Paired Singles enabled\n");
+                }
+
+                if (HID2.wpe != 0) {
+                    printf("HID2 Write-gather pipe enabled\n");
+                }
+
+                if (HID2.lsqe != 0) {
+                    printf("HID2 Quantized loadstores enabled\n");
+                }
+
+                if (HID2.lce != lce) {
+                    SetLockedCache(HID2.lce);
+                }
+                break;
             }
-            break;
-        case SPR_MMCR0:
-            printf("MMCR0 write (data: %08X)\n", data);
+        case SPR_DMAU:
+            printf("DMAU write (data: %08X)\n", data);
 
-            MMCR0.raw = data;
+            DMAU.raw = data;
+            break;
+        case SPR_DMAL:
+            printf("DMAL write (data: %08X)\n", data);
+
+            DMAL.raw = data;
+
+            if (DMAL.f != 0) {
+                printf("Broadway Locked cache DMA queue flushed\n");
+
+                ctx.numDmas = 0;
+                ctx.dmaGen++;
+
+                HID2.dmaql = 0;
+
+                DMAL.f = 0;
+                DMAL.t = 0;
+            } else if (DMAL.t != 0) {
+                QueueDma();
+            }
+            break;
+        case SPR_MMCR0:
+            printf("MMCR0 write (data: %08X)\n", data);
+
+            MMCR0.raw = data;
             break;
         case SPR_PMC1:
             printf("PMC1 write (data: %08X)\n", data);
@@ -988,6 +1652,10 @@ static void SetSpr(const u32 spr, const u32 data) {
             if (HID4.sbe != 0) {
                 printf("HID4 secondary BATs enabled\n");
             }
+
+            UpdateSegments();
+
+            codecache_Unlink();
             break;
         case SPR_L2CR:
             printf("L2CR write (data: %08X)\n", data);
@@ -1013,22 +1681,32 @@ static void SetSpr(const u32 spr, const u32 data) {
 }
 
 static void ADD(const u32 instr) {
-    ctx.r[RD] = ctx.r[RA] + ctx.r[RB];
+    const u32 a = ctx.r[RA];
+    const u32 b = ctx.r[RB];
+
+    ctx.r[RD] = a + b;
+
+    SetOverflow(instr, AddOverflows(a, b, ctx.r[RD]));
 
     if (RC) {
         SetFlags(0, ctx.r[RD]);
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] add%s r%u, r%u, r%u; r%u: %08X\n", CIA, (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD]);
+    printf("PPC [%08X] add%s%s r%u, r%u, r%u; r%u: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD]);
 #endif
 }
 
 static void ADDC(const u32 instr) {
-    const u64 n = (u64)ctx.r[RA] + (u64)ctx.r[RB];
+    const u32 a = ctx.r[RA];
+    const u32 b = ctx.r[RB];
+
+    const u64 n = (u64)a + (u64)b;
 
     XER.ca = (n >> 32) & 1;
 
+    SetOverflow(instr, AddOverflows(a, b, (u32)n));
+
     ctx.r[RD] = (u32)n;
 
     if (RC) {
@@ -1036,15 +1714,20 @@ static void ADDC(const u32 instr) {
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] addc%s r%u, r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD], XER.raw);
+    printf("PPC [%08X] addc%s%s r%u, r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD], XER.raw);
 #endif
 }
 
 static void ADDE(const u32 instr) {
-    const u64 n = (u64)ctx.r[RA] + (u64)ctx.r[RB] + (u64)XER.ca;
+    const u32 a = ctx.r[RA];
+    const u32 b = ctx.r[RB];
+
+    const u64 n = (u64)a + (u64)b + (u64)XER.ca;
 
     XER.ca = (n >> 32) & 1;
 
+    SetOverflow(instr, AddOverflows(a, b, (u32)n));
+
     ctx.r[RD] = (u32)n;
 
     if (RC) {
@@ -1052,7 +1735,7 @@ static void ADDE(const u32 instr) {
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] adde%s r%u, r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD], XER.raw);
+    printf("PPC [%08X] adde%s%s r%u, r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD], XER.raw);
 #endif
 }
 
@@ -1071,11 +1754,11 @@ static void ADDI(const u32 instr) {
 }
 
 static void ADDIC(const u32 instr) {
-    const u64 n = (u64)ctx.r[RA] + (u64)SIMM;
+    const u64 n = (u64)ctx.r[RA] + (u64)(u32)SIMM;
 
     XER.ca = (n >> 32) & 1;
 
-    ctx.r[RD] = ctx.r[RA] + (u64)SIMM;
+    ctx.r[RD] = (u32)n;
 
 #ifdef BROADWAY_DEBUG
     printf("PPC [%08X] addic r%u, r%u, %X; r%u: %08X, xer: %08X\n", CIA, RD, RA, UIMM, RD, ctx.r[RD], XER.raw);
@@ -1083,7 +1766,7 @@ static void ADDIC(const u32 instr) {
 }
 
 static void ADDICrc(const u32 instr) {
-    const u64 n = (u64)ctx.r[RA] + (u64)SIMM;
+    const u64 n = (u64)ctx.r[RA] + (u64)(u32)SIMM;
 
     XER.ca = (n >> 32) & 1;
 
@@ -1111,10 +1794,14 @@ static void ADDIS(const u32 instr) {
 }
 
 static void ADDZE(const u32 instr) {
-    const u64 n = (u64)ctx.r[RA] + (u64)XER.ca;
+    const u32 a = ctx.r[RA];
+
+    const u64 n = (u64)a + (u64)XER.ca;
 
     XER.ca = (n >> 32) & 1;
 
+    SetOverflow(instr, AddOverflows(a, 0, (u32)n));
+
     ctx.r[RD] = (u32)n;
 
     if (RC) {
@@ -1122,7 +1809,7 @@ static void ADDZE(const u32 instr) {
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] addze%s r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (RC) ? "." : "", RD, RA, RD, ctx.r[RD], XER.raw);
+    printf("PPC [%08X] addze%s%s r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RD, ctx.r[RD], XER.raw);
 #endif
 }
 
@@ -1381,30 +2068,41 @@ static void CRXOR(const u32 instr) {
 }
 
 static void DCBF(const u32 instr) {
-    u32 addr = ctx.r[RB];
+    // Data cache isn't emulated
+    (void)instr;
 
-    if (RA != 0) {
-        addr += ctx.r[RA];
-    }
+#ifdef BROADWAY_DEBUG
+    printf("PPC [%08X] dcbf r%u, r%u; flush block @ [%08X]\n", CIA, RA, RB, ((RA != 0) ? ctx.r[RA] : 0) + ctx.r[RB]);
+#endif
+}
 
-    // TODO: Implement data cache?
+static void DCBI(const u32 instr) {
+    // Data cache isn't emulated
+    (void)instr;
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] dcbf r%u, r%u; flush block @ [%08X]\n", CIA, RA, RB, addr);
+    printf("PPC [%08X] dcbi r%u, r%u; invalidate block @ [%08X]\n", CIA, RA, RB, ((RA != 0) ? ctx.r[RA] : 0) + ctx.r[RB]);
 #endif
 }
 
-static void DCBI(const u32 instr) {
+static void DCBZL(const u32 instr) {
+    assert(HID2.lce != 0);
+
     u32 addr = ctx.r[RB];
 
     if (RA != 0) {
         addr += ctx.r[RA];
     }
 
-    // TODO: Implement data cache?
+    addr &= ~(SIZE_CACHE_BLOCK - 1);
+
+    // Allocates a locked cache block, only the zeroing is visible to software
+    for (u32 i = 0; i < SIZE_CACHE_BLOCK; i += sizeof(u64)) {
+        Write64(addr + i, 0);
+    }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] dcbf r%u, r%u; invalidate block @ [%08X]\n", CIA, RA, RB, addr);
+    printf("PPC [%08X] dcbz_l r%u, r%u; clear block @ [%08X]\n", CIA, RA, RB, addr);
 #endif
 }
 
@@ -1415,9 +2113,16 @@ static void DCBZ(const u32 instr) {
         addr += ctx.r[RA];
     }
 
-    // HACK
-    for (u32 i = 0; i < SIZE_CACHE_BLOCK; i += sizeof(u64)) {
-        Write64(addr + i, 0);
+    addr &= ~(SIZE_CACHE_BLOCK - 1);
+
+    u8* mem = GetSpan(addr, SIZE_CACHE_BLOCK, ACCESS_WRITE);
+
+    if (mem != NULL) {
+        memset(mem, 0, SIZE_CACHE_BLOCK);
+    } else {
+        for (u32 i = 0; i < SIZE_CACHE_BLOCK; i += sizeof(u64)) {
+            Write64(addr + i, 0);
+        }
     }
 
 #ifdef BROADWAY_DEBUG
@@ -1429,17 +2134,23 @@ static void DIVW(const u32 instr) {
     const i32 n = (i32)ctx.r[RA];
     const i32 d = (i32)ctx.r[RB];
 
-    assert(d != 0);
-    assert(!((n == INT32_MIN) && (d == -1)));
+    const int overflow = (d == 0) || ((n == INT32_MIN) && (d == -1));
 
-    ctx.r[RD] = (u32)(n / d);
+    SetOverflow(instr, overflow);
+
+    if (overflow) {
+        // Undefined, Broadway sign-extends the dividend
+        ctx.r[RD] = (n < 0) ? 0xFFFFFFFF : 0;
+    } else {
+        ctx.r[RD] = (u32)(n / d);
+    }
 
     if (RC) {
         SetFlags(0, ctx.r[RD]);
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] divw%s r%u, r%u, r%u; r%u: %08X\n", CIA, (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD]);
+    printf("PPC [%08X] divw%s%s r%u, r%u, r%u; r%u: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD]);
 #endif
 }
 
@@ -1447,16 +2158,17 @@ static void DIVWU(const u32 instr) {
     const u32 n = ctx.r[RA];
     const u32 d = ctx.r[RB];
 
-    assert(d != 0);
+    SetOverflow(instr, d == 0);
 
-    ctx.r[RD] = n / d;
+    // Undefined for a zero divisor, Broadway returns 0
+    ctx.r[RD] = (d != 0) ? (n / d) : 0;
 
     if (RC) {
         SetFlags(0, ctx.r[RD]);
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] divwu%s r%u, r%u, r%u; r%u: %08X\n", CIA, (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD]);
+    printf("PPC [%08X] divwu%s%s r%u, r%u, r%u; r%u: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD]);
 #endif
 }
 
@@ -1524,7 +2236,20 @@ static void FCTIWZ(const u32 instr) {
     // TODO: Implement flags
     assert(!RC);
 
-    ctx.fprs[RD].raw[0] = (u32)floor(ctx.fprs[RB].PS0);
+    const f64 n = trunc(ctx.fprs[RB].PS0);
+
+    // Out of range values and NaNs saturate
+    i32 result;
+
+    if (n >= 2147483647.0) {
+        result = INT32_MAX;
+    } else if ((n >= -2147483648.0) && !isnan(n)) {
+        result = (i32)n;
+    } else {
+        result = INT32_MIN;
+    }
+
+    ctx.fprs[RD].raw[0] = (u32)result;
 
 #ifdef BROADWAY_DEBUG_FLOATS
     printf("PPC [%08X] fctiwz%s f%u, f%u; ps0: %lf\n", CIA, (RC) ? "." : "", RD, RB, ctx.fprs[RD].raw[0]);
@@ -1619,7 +2344,10 @@ static void ICBI(const u32 instr) {
         addr += ctx.r[RA];
     }
 
-    // TODO: Implement instruction cache?
+    // Stores and DMA invalidate compiled code already, this only catches host-side writes
+    // that bypass the memory layer. Afterwards the page is no longer write-protected, so
+    // the rest of an icbi loop over the same page is free
+    memory_UnprotectCode(Translate(addr, ACCESS_READ));
 
 #ifdef BROADWAY_DEBUG
     printf("PPC [%08X] icbi r%u, r%u; invalidate block @ [%08X]\n", CIA, RA, RB, addr);
@@ -1775,10 +2503,18 @@ static void LMW(const u32 instr) {
         addr += ctx.r[RA];
     }
 
-    for (int r = RD; r < NUM_GPRS; r++) {
-        ctx.r[r] = Read32(addr, NOUWII_FALSE);
+    const u32 numRegs = NUM_GPRS - RD;
 
-        addr += sizeof(u32);
+    const u8* mem = GetSpan(addr, numRegs * sizeof(u32), ACCESS_READ);
+
+    if (mem != NULL) {
+        common_Bswap32Array(&ctx.r[RD], mem, numRegs);
+    } else {
+        for (u32 r = RD; r < NUM_GPRS; r++) {
+            ctx.r[r] = Read32(addr, NOUWII_FALSE);
+
+            addr += sizeof(u32);
+        }
     }
 
 #ifdef BROADWAY_DEBUG
@@ -1800,16 +2536,35 @@ static void LSWI(const u32 instr) {
         n = 32;
     }
 
-    u32 r = RD;
-    u32 i = 0;
+    const u8* mem = GetSpan(addr, n, ACCESS_READ);
 
-    for (; n > 0; n--) {
-        ctx.r[r] = SetBits(ctx.r[r], i, i + 7, (u32)Read8(addr++, NOUWII_FALSE));
+    if (mem != NULL) {
+        // Unused bytes of the last register are cleared
+        u8 bytes[MAX_STRING_BYTES] = {0};
+        memcpy(bytes, mem, n);
 
-        i = (i + 8) & 31;
+        u32 words[MAX_STRING_BYTES / sizeof(u32)];
+        common_Bswap32Array(words, bytes, (n + 3) / sizeof(u32));
 
-        if (i == 0) {
-            r = (r + 1) & (NUM_GPRS - 1);
+        for (u32 i = 0; i < ((n + 3) / sizeof(u32)); i++) {
+            ctx.r[(RD + i) & (NUM_GPRS - 1)] = words[i];
+        }
+    } else {
+        u32 r = RD;
+        u32 i = 0;
+
+        for (; n > 0; n--) {
+            if (i == 0) {
+                ctx.r[r] = 0;
+            }
+
+            ctx.r[r] = SetBits(ctx.r[r], i, i + 7, (u32)Read8(addr++, NOUWII_FALSE));
+
+            i = (i + 8) & 31;
+
+            if (i == 0) {
+                r = (r + 1) & (NUM_GPRS - 1);
+            }
         }
     }
 
@@ -1906,6 +2661,22 @@ static void MFSPR(const u32 instr) {
 #endif
 }
 
+static void MFSR(const u32 instr) {
+    ctx.r[RD] = SR[GetBits(instr, 12, 15)].raw;
+
+#ifdef BROADWAY_DEBUG
+    printf("PPC [%08X] mfsr r%u, sr%u; r%u: %08X\n", CIA, RD, GetBits(instr, 12, 15), RD, ctx.r[RD]);
+#endif
+}
+
+static void MFSRIN(const u32 instr) {
+    ctx.r[RD] = SR[ctx.r[RB] >> 28].raw;
+
+#ifdef BROADWAY_DEBUG
+    printf("PPC [%08X] mfsrin r%u, r%u; r%u: %08X\n", CIA, RD, RB, RD, ctx.r[RD]);
+#endif
+}
+
 static void MFTB(const u32 instr) {
     ctx.r[RD] = GetSpr(SPR);
 
@@ -1951,6 +2722,8 @@ static void MTFSF(const u32 instr) {
 static void MTMSR(const u32 instr) {
     MSR.raw = ctx.r[RS];
 
+    codecache_Unlink();
+
     CheckInterrupt();
 
 #ifdef BROADWAY_DEBUG
@@ -1967,16 +2740,31 @@ static void MTSPR(const u32 instr) {
 }
 
 static void MTSR(const u32 instr) {
-    (void)instr;
+    const u32 sr = GetBits(instr, 12, 15);
+
+    SR[sr].raw = ctx.r[RS];
+
+    codecache_Unlink();
+
+#ifdef BROADWAY_DEBUG
+    printf("PPC [%08X] mtsr sr%u, r%u; sr%u: %08X\n", CIA, sr, RS, sr, ctx.r[RS]);
+#endif
+}
+
+static void MTSRIN(const u32 instr) {
+    const u32 sr = ctx.r[RB] >> 28;
+
+    SR[sr].raw = ctx.r[RS];
+
+    codecache_Unlink();
 
-    // TODO: Implement SRs
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] mtsr sr%u, r%u; sr%u: %08X\n", CIA, RA, RS, RA, ctx.r[RS]);
+    printf("PPC [%08X] mtsrin r%u, r%u; sr%u: %08X\n", CIA, RS, RB, sr, ctx.r[RS]);
 #endif
 }
 
 static void MULHW(const u32 instr) {
-    ctx.r[RD] = (u32)(((i64)ctx.r[RA] * (i64)ctx.r[RB]) >> 32);
+    ctx.r[RD] = (u32)(((i64)(i32)ctx.r[RA] * (i64)(i32)ctx.r[RB]) >> 32);
 
     if (RC) {
         SetFlags(0, ctx.r[RD]);
@@ -2008,18 +2796,24 @@ static void MULLI(const u32 instr) {
 }
 
 static void MULLW(const u32 instr) {
-    ctx.r[RD] = ctx.r[RA] * ctx.r[RB];
+    const i64 n = (i64)(i32)ctx.r[RA] * (i64)(i32)ctx.r[RB];
+
+    SetOverflow(instr, n != (i64)(i32)n);
+
+    ctx.r[RD] = (u32)n;
 
     if (RC) {
         SetFlags(0, ctx.r[RD]);
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] mullw%s r%u, r%u, r%u; r%u: %08X\n", CIA, (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD]);
+    printf("PPC [%08X] mullw%s%s r%u, r%u, r%u; r%u: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD]);
 #endif
 }
 
 static void NEG(const u32 instr) {
+    SetOverflow(instr, ctx.r[RA] == 0x80000000);
+
     ctx.r[RD] = -ctx.r[RA];
 
     if (RC) {
@@ -2027,7 +2821,7 @@ static void NEG(const u32 instr) {
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] neg%s r%u, r%u; r%u: %08X\n", CIA, (RC) ? "." : "", RD, RA, RD, ctx.r[RD]);
+    printf("PPC [%08X] neg%s%s r%u, r%u; r%u: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RD, ctx.r[RD]);
 #endif
 }
 
@@ -2238,6 +3032,8 @@ static void RFI(const u32 instr) {
 
     IA = SRR0;
 
+    codecache_Unlink();
+
     CheckInterrupt();
 
 #ifdef BROADWAY_DEBUG
@@ -2454,10 +3250,18 @@ static void STMW(const u32 instr) {
         addr += ctx.r[RA];
     }
 
-    for (int r = RS; r < NUM_GPRS; r++) {
-        Write32(addr, ctx.r[r]);
+    const u32 numRegs = NUM_GPRS - RS;
+
+    u8* mem = GetSpan(addr, numRegs * sizeof(u32), ACCESS_WRITE);
+
+    if (mem != NULL) {
+        common_Bswap32Array(mem, &ctx.r[RS], numRegs);
+    } else {
+        for (u32 r = RS; r < NUM_GPRS; r++) {
+            Write32(addr, ctx.r[r]);
 
-        addr += sizeof(u32);
+            addr += sizeof(u32);
+        }
     }
 
 #ifdef BROADWAY_DEBUG
@@ -2479,16 +3283,31 @@ static void STSWI(const u32 instr) {
         n = 32;
     }
 
-    u32 r = RS;
-    u32 i = 0;
+    u8* mem = GetSpan(addr, n, ACCESS_WRITE);
+
+    if (mem != NULL) {
+        u32 words[MAX_STRING_BYTES / sizeof(u32)];
+
+        for (u32 i = 0; i < ((n + 3) / sizeof(u32)); i++) {
+            words[i] = ctx.r[(RS + i) & (NUM_GPRS - 1)];
+        }
+
+        u8 bytes[MAX_STRING_BYTES];
+        common_Bswap32Array(bytes, words, (n + 3) / sizeof(u32));
+
+        memcpy(mem, bytes, n);
+    } else {
+        u32 r = RS;
+        u32 i = 0;
 
-    for (; n > 0; n--) {
-        Write8(addr++, GetBits(ctx.r[r], i, i + 7));
+        for (; n > 0; n--) {
+            Write8(addr++, GetBits(ctx.r[r], i, i + 7));
 
-        i = (i + 8) & 31;
+            i = (i + 8) & 31;
 
-        if (i == 0) {
-            r = (r + 1) & (NUM_GPRS - 1);
+            if (i == 0) {
+                r = (r + 1) & (NUM_GPRS - 1);
+            }
         }
     }
 
@@ -2555,10 +3374,15 @@ static void STWX(const u32 instr) {
 }
 
 static void SUBFE(const u32 instr) {
-    const u64 n = (u64)(u32)(~ctx.r[RA]) + (u64)ctx.r[RB] + (u64)XER.ca;
+    const u32 a = ~ctx.r[RA];
+    const u32 b = ctx.r[RB];
+
+    const u64 n = (u64)a + (u64)b + (u64)XER.ca;
 
     XER.ca = (n >> 32) & 1;
 
+    SetOverflow(instr, AddOverflows(a, b, (u32)n));
+
     ctx.r[RD] = (u32)n;
 
     if (RC) {
@@ -2566,27 +3390,37 @@ static void SUBFE(const u32 instr) {
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] subfe%s r%u, r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD], XER.raw);
+    printf("PPC [%08X] subfe%s%s r%u, r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD], XER.raw);
 #endif
 }
 
 static void SUBF(const u32 instr) {
-    ctx.r[RD] = ctx.r[RB] - ctx.r[RA];
+    const u32 a = ~ctx.r[RA];
+    const u32 b = ctx.r[RB];
+
+    ctx.r[RD] = a + b + 1;
+
+    SetOverflow(instr, AddOverflows(a, b, ctx.r[RD]));
 
     if (RC) {
         SetFlags(0, ctx.r[RD]);
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] subf%s r%u, r%u, r%u; r%u: %08X\n", CIA, (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD]);
+    printf("PPC [%08X] subf%s%s r%u, r%u, r%u; r%u: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD]);
 #endif
 }
 
 static void SUBFC(const u32 instr) {
-    const u64 n = (u64)ctx.r[RB] - (u64)ctx.r[RA];
+    const u32 a = ~ctx.r[RA];
+    const u32 b = ctx.r[RB];
+
+    const u64 n = (u64)a + (u64)b + 1;
 
     XER.ca = (n >> 32) & 1;
 
+    SetOverflow(instr, AddOverflows(a, b, (u32)n));
+
     ctx.r[RD] = (u32)n;
 
     if (RC) {
@@ -2594,12 +3428,12 @@ static void SUBFC(const u32 instr) {
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] subfc%s r%u, r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD], XER.raw);
+    printf("PPC [%08X] subfc%s%s r%u, r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD], XER.raw);
 #endif
 }
 
 static void SUBFIC(const u32 instr) {
-    const u64 n = (u64)SIMM - (u64)ctx.r[RA];
+    const u64 n = (u64)(u32)(~ctx.r[RA]) + (u64)(u32)SIMM + 1;
 
     XER.ca = (n >> 32) & 1;
 
@@ -2611,10 +3445,14 @@ static void SUBFIC(const u32 instr) {
 }
 
 static void SUBFZE(const u32 instr) {
-    const u64 n = (u64)(u32)(~ctx.r[RA]) + (u64)XER.ca;
+    const u32 a = ~ctx.r[RA];
+
+    const u64 n = (u64)a + (u64)XER.ca;
 
     XER.ca = (n >> 32) & 1;
 
+    SetOverflow(instr, AddOverflows(a, 0, (u32)n));
+
     ctx.r[RD] = (u32)n;
 
     if (RC) {
@@ -2622,7 +3460,7 @@ static void SUBFZE(const u32 instr) {
     }
 
 #ifdef BROADWAY_DEBUG
-    printf("PPC [%08X] subfze%s r%u, r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD], XER.raw);
+    printf("PPC [%08X] subfze%s%s r%u, r%u, r%u; r%u: %08X, xer: %08X\n", CIA, (OE) ? "o" : "", (RC) ? "." : "", RD, RA, RB, RD, ctx.r[RD], XER.raw);
 #endif
 }
 
@@ -2634,6 +3472,24 @@ static void SYNC(const u32 instr) {
 #endif
 }
 
+static void TLBIE(const u32 instr) {
+    InvalidateTlbSet(ctx.r[RB]);
+
+    codecache_Unlink();
+
+#ifdef BROADWAY_DEBUG
+    printf("PPC [%08X] tlbie r%u; invalidate set @ [%08X]\n", CIA, RB, ctx.r[RB]);
+#endif
+}
+
+static void TLBSYNC(const u32 instr) {
+    (void)instr;
+
+#ifdef BROADWAY_DEBUG
+    printf("PPC [%08X] tlbsync\n", CIA);
+#endif
+}
+
 static void XOR(const u32 instr) {
     ctx.r[RA] = ctx.r[RS] ^ ctx.r[RB];
 
@@ -2662,439 +3518,1330 @@ static void XORIS(const u32 instr) {
 #endif
 }
 
-static void ExecInstr(const u32 instr) {
+static void UnimplementedPairedSingle(const u32 instr) {
+    printf("Unimplemented Broadway Paired Single opcode %u (IA: %08X, instruction: %08X)\n", XO, CIA, instr);
+
+    exit(1);
+}
+
+static void UnimplementedSystem(const u32 instr) {
+    printf("Unimplemented Broadway system opcode %u (IA: %08X, instruction: %08X)\n", XO, CIA, instr);
+
+    exit(1);
+}
+
+static void UnimplementedSecondary(const u32 instr) {
+    printf("Unimplemented Broadway secondary opcode %u (IA: %08X, instruction: %08X)\n", XO, CIA, instr);
+
+    exit(1);
+}
+
+static void UnimplementedFloat(const u32 instr) {
+    printf("Unimplemented Broadway float opcode %u (IA: %08X, instruction: %08X)\n", XO, CIA, instr);
+
+    exit(1);
+}
+
+static void UnimplementedPrimary(const u32 instr) {
+    printf("Unimplemented Broadway primary opcode %u (IA: %08X, instruction: %08X)\n", OPCD, CIA, instr);
+
+    exit(1);
+}
+
+static codecache_Handler DecodeInstr(const u32 instr) {
     switch (OPCD) {
         case PRIMARY_PAIREDSINGLE:
             switch (XO) {
                 case PAIREDSINGLE_PSMR:
-                    PSMR(instr);
-                    break;
+                    return PSMR;
                 case PAIREDSINGLE_PSMERGE01:
-                    PSMERGE01(instr);
-                    break;
+                    return PSMERGE01;
                 case PAIREDSINGLE_PSMERGE10:
-                    PSMERGE10(instr);
-                    break;
+                    return PSMERGE10;
+                case PAIREDSINGLE_DCBZL:
+                    return DCBZL;
                 default:
-                    printf("Unimplemented Broadway Paired Single opcode %u (IA: %08X, instruction: %08X)\n", XO, CIA, instr);
-
-                    exit(1);
+                    return UnimplementedPairedSingle;
             }
-            break;
         case PRIMARY_MULLI:
-            MULLI(instr);
-            break;
+            return MULLI;
         case PRIMARY_SUBFIC:
-            SUBFIC(instr);
-            break;
+            return SUBFIC;
         case PRIMARY_CMPLI:
-            CMPLI(instr);
-            break;
+            return CMPLI;
         case PRIMARY_CMPI:
-            CMPI(instr);
-            break;
+            return CMPI;
         case PRIMARY_ADDIC:
-            ADDIC(instr);
-            break;
+            return ADDIC;
         case PRIMARY_ADDICrc:
-            ADDICrc(instr);
-            break;
+            return ADDICrc;
         case PRIMARY_ADDI:
-            ADDI(instr);
-            break;
+            return ADDI;
         case PRIMARY_ADDIS:
-            ADDIS(instr);
-            break;
+            return ADDIS;
         case PRIMARY_BC:
-            BC(instr);
-            break;
+            return BC;
         case PRIMARY_SC:
-            SC(instr);
-            break;
+            return SC;
         case PRIMARY_B:
-            B(instr);
-            break;
+            return B;
         case PRIMARY_SYSTEM:
             switch (XO) {
                 case SYSTEM_MCRF:
-                    MCRF(instr);
-                    break;
+                    return MCRF;
                 case SYSTEM_BCLR:
-                    BCLR(instr);
-                    break;
+                    return BCLR;
                 case SYSTEM_CRNOR:
-                    CRNOR(instr);
-                    break;
+                    return CRNOR;
                 case SYSTEM_RFI:
-                    RFI(instr);
-                    break;
+                    return RFI;
                 case SYSTEM_ISYNC:
-                    ISYNC(instr);
-                    break;
+                    return ISYNC;
                 case SYSTEM_CRXOR:
-                    CRXOR(instr);
-                    break;
+                    return CRXOR;
                 case SYSTEM_CREQV:
-                    CREQV(instr);
-                    break;
+                    return CREQV;
                 case SYSTEM_BCCTR:
-                    BCCTR(instr);
-                    break;
+                    return BCCTR;
                 default:
-                    printf("Unimplemented Broadway system opcode %u (IA: %08X, instruction: %08X)\n", XO, CIA, instr);
-
-                    exit(1);
+                    return UnimplementedSystem;
             }
-            break;
         case PRIMARY_RLWIMI:
-            RLWIMI(instr);
-            break;
+            return RLWIMI;
         case PRIMARY_RLWINM:
-            RLWINM(instr);
-            break;
+            return RLWINM;
         case PRIMARY_ORI:
-            ORI(instr);
-            break;
+            return ORI;
         case PRIMARY_ORIS:
-            ORIS(instr);
-            break;
+            return ORIS;
         case PRIMARY_XORI:
-            XORI(instr);
-            break;
+            return XORI;
         case PRIMARY_XORIS:
-            XORIS(instr);
-            break;
+            return XORIS;
         case PRIMARY_ANDIrc:
-            ANDIrc(instr);
-            break;
+            return ANDIrc;
         case PRIMARY_ANDISrc:
-            ANDISrc(instr);
-            break;
+            return ANDISrc;
         case PRIMARY_REGISTER:
             switch (XO) {
                 case SECONDARY_CMP:
-                    CMP(instr);
-                    break;
+                    return CMP;
                 case SECONDARY_SUBFC:
-                    SUBFC(instr);
-                    break;
+                    return SUBFC;
                 case SECONDARY_ADDC:
-                    ADDC(instr);
-                    break;
+                    return ADDC;
                 case SECONDARY_MULHWU:
-                    MULHWU(instr);
-                    break;
+                    return MULHWU;
                 case SECONDARY_MFCR:
-                    MFCR(instr);
-                    break;
+                    return MFCR;
                 case SECONDARY_LWZX:
-                    LWZX(instr);
-                    break;
+                    return LWZX;
                 case SECONDARY_SLW:
-                    SLW(instr);
-                    break;
+                    return SLW;
                 case SECONDARY_CNTLZW:
-                    CNTLZW(instr);
-                    break;
+                    return CNTLZW;
                 case SECONDARY_AND:
-                    AND(instr);
-                    break;
+                    return AND;
                 case SECONDARY_CMPL:
-                    CMPL(instr);
-                    break;
+                    return CMPL;
                 case SECONDARY_SUBF:
-                    SUBF(instr);
-                    break;
+                    return SUBF;
                 case SECONDARY_LWZUX:
-                    LWZUX(instr);
-                    break;
+                    return LWZUX;
                 case SECONDARY_ANDC:
-                    ANDC(instr);
-                    break;
+                    return ANDC;
                 case SECONDARY_MULHW:
-                    MULHW(instr);
-                    break;
+                    return MULHW;
                 case SECONDARY_MFMSR:
-                    MFMSR(instr);
-                    break;
+                    return MFMSR;
                 case SECONDARY_DCBF:
-                    DCBF(instr);
-                    break;
+                    return DCBF;
                 case SECONDARY_LBZX:
-                    LBZX(instr);
-                    break;
+                    return LBZX;
                 case SECONDARY_NEG:
-                    NEG(instr);
-                    break;
+                    return NEG;
                 case SECONDARY_NOR:
-                    NOR(instr);
-                    break;
+                    return NOR;
                 case SECONDARY_SUBFE:
-                    SUBFE(instr);
-                    break;
+                    return SUBFE;
                 case SECONDARY_ADDE:
-                    ADDE(instr);
-                    break;
+                    return ADDE;
                 case SECONDARY_MTCR:
-                    MTCR(instr);
-                    break;
+                    return MTCR;
                 case SECONDARY_MTMSR:
-                    MTMSR(instr);
-                    break;
+                    return MTMSR;
                 case SECONDARY_STWX:
-                    STWX(instr);
-                    break;
+                    return STWX;
                 case SECONDARY_STWUX:
-                    STWUX(instr);
-                    break;
+                    return STWUX;
                 case SECONDARY_SUBFZE:
-                    SUBFZE(instr);
-                    break;
+                    return SUBFZE;
                 case SECONDARY_ADDZE:
-                    ADDZE(instr);
-                    break;
+                    return ADDZE;
                 case SECONDARY_MTSR:
-                    MTSR(instr);
-                    break;
+                    return MTSR;
+                case SECONDARY_MTSRIN:
+                    return MTSRIN;
                 case SECONDARY_STBX:
-                    STBX(instr);
-                    break;
+                    return STBX;
                 case SECONDARY_MULLW:
-                    MULLW(instr);
-                    break;
+                    return MULLW;
                 case SECONDARY_ADD:
-                    ADD(instr);
-                    break;
+                    return ADD;
                 case SECONDARY_LHZX:
-                    LHZX(instr);
-                    break;
+                    return LHZX;
+                case SECONDARY_TLBIE:
+                    return TLBIE;
                 case SECONDARY_XOR:
-                    XOR(instr);
-                    break;
+                    return XOR;
                 case SECONDARY_MFSPR:
-                    MFSPR(instr);
-                    break;
+                    return MFSPR;
                 case SECONDARY_MFTB:
-                    MFTB(instr);
-                    break;
+                    return MFTB;
                 case SECONDARY_STHX:
-                    STHX(instr);
-                    break;
+                    return STHX;
                 case SECONDARY_ORC:
-                    ORC(instr);
-                    break;
+                    return ORC;
                 case SECONDARY_OR:
-                    OR(instr);
-                    break;
+                    return OR;
                 case SECONDARY_DIVWU:
-                    DIVWU(instr);
-                    break;
+                    return DIVWU;
                 case SECONDARY_MTSPR:
-                    MTSPR(instr);
-                    break;
+                    return MTSPR;
                 case SECONDARY_DCBI:
-                    DCBI(instr);
-                    break;
+                    return DCBI;
                 case SECONDARY_DIVW:
-                    DIVW(instr);
-                    break;
+                    return DIVW;
+                case SECONDARY_SUBFCO:
+                    return SUBFC;
+                case SECONDARY_ADDCO:
+                    return ADDC;
                 case SECONDARY_SRW:
-                    SRW(instr);
-                    break;
+                    return SRW;
+                case SECONDARY_SUBFO:
+                    return SUBF;
+                case SECONDARY_TLBSYNC:
+                    return TLBSYNC;
+                case SECONDARY_MFSR:
+                    return MFSR;
                 case SECONDARY_LSWI:
-                    LSWI(instr);
-                    break;
+                    return LSWI;
                 case SECONDARY_SYNC:
-                    SYNC(instr);
-                    break;
+                    return SYNC;
                 case SECONDARY_LFDX:
-                    LFDX(instr);
-                    break;
+                    return LFDX;
+                case SECONDARY_NEGO:
+                    return NEG;
+                case SECONDARY_SUBFEO:
+                    return SUBFE;
+                case SECONDARY_ADDEO:
+                    return ADDE;
+                case SECONDARY_MFSRIN:
+                    return MFSRIN;
+                case SECONDARY_SUBFZEO:
+                    return SUBFZE;
+                case SECONDARY_ADDZEO:
+                    return ADDZE;
                 case SECONDARY_STSWI:
-                    STSWI(instr);
-                    break;
+                    return STSWI;
+                case SECONDARY_MULLWO:
+                    return MULLW;
+                case SECONDARY_ADDO:
+                    return ADD;
                 case SECONDARY_SRAW:
-                    SRAW(instr);
-                    break;
+                    return SRAW;
                 case SECONDARY_SRAWI:
-                    SRAWI(instr);
-                    break;
+                    return SRAWI;
                 case SECONDARY_EXTSH:
-                    EXTSH(instr);
-                    break;
+                    return EXTSH;
                 case SECONDARY_EXTSB:
-                    EXTSB(instr);
-                    break;
+                    return EXTSB;
+                case SECONDARY_DIVWUO:
+                    return DIVWU;
                 case SECONDARY_ICBI:
-                    ICBI(instr);
-                    break;
+                    return ICBI;
                 case SECONDARY_STFIWX:
-                    STFIWX(instr);
-                    break;
+                    return STFIWX;
+                case SECONDARY_DIVWO:
+                    return DIVW;
                 case SECONDARY_DCBZ:
-                    DCBZ(instr);
-                    break;
+                    return DCBZ;
                 default:
-                    printf("Unimplemented Broadway secondary opcode %u (IA: %08X, instruction: %08X)\n", XO, CIA, instr);
-
-                    exit(1);
+                    return UnimplementedSecondary;
             }
-            break;
         case PRIMARY_LWZ:
-            LWZ(instr);
-            break;
+            return LWZ;
         case PRIMARY_LWZU:
-            LWZU(instr);
-            break;
+            return LWZU;
         case PRIMARY_LBZ:
-            LBZ(instr);
-            break;
+            return LBZ;
         case PRIMARY_LBZU:
-            LBZU(instr);
-            break;
+            return LBZU;
         case PRIMARY_STW:
-            STW(instr);
-            break;
+            return STW;
         case PRIMARY_STWU:
-            STWU(instr);
-            break;
+            return STWU;
         case PRIMARY_STB:
-            STB(instr);
-            break;
+            return STB;
         case PRIMARY_STBU:
-            STBU(instr);
-            break;
+            return STBU;
         case PRIMARY_LHZ:
-            LHZ(instr);
-            break;
+            return LHZ;
         case PRIMARY_LHA:
-            LHA(instr);
-            break;
+            return LHA;
         case PRIMARY_STH:
-            STH(instr);
-            break;
+            return STH;
         case PRIMARY_LMW:
-            LMW(instr);
-            break;
+            return LMW;
         case PRIMARY_STMW:
-            STMW(instr);
-            break;
+            return STMW;
         case PRIMARY_LFS:
-            LFS(instr);
-            break;
+            return LFS;
         case PRIMARY_LFD:
-            LFD(instr);
-            break;
+            return LFD;
         case PRIMARY_STFS:
-            STFS(instr);
-            break;
+            return STFS;
         case PRIMARY_STFD:
-            STFD(instr);
-            break;
+            return STFD;
         case PRIMARY_PSQL:
-            PSQL(instr);
-            break;
+            return PSQL;
         case PRIMARY_PSQST:
-            PSQST(instr);
-            break;
+            return PSQST;
         case PRIMARY_FLOAT:
             switch (FXO) {
                 case FLOAT_FDIV:
-                    FDIV(instr);
-                    break;
+                    return FDIV;
                 case FLOAT_FSUB:
-                    FSUB(instr);
-                    break;
+                    return FSUB;
                 case FLOAT_FADD:
-                    FADD(instr);
-                    break;
+                    return FADD;
                 case FLOAT_FMUL:
-                    FMUL(instr);
-                    break;
+                    return FMUL;
                 case FLOAT_FMSUB:
-                    FMSUB(instr);
-                    break;
+                    return FMSUB;
                 case FLOAT_FMADD:
-                    FMADD(instr);
-                    break;
+                    return FMADD;
                 default:
                     switch (XO) {
                         case FLOAT_FCMPU:
-                            FCMPU(instr);
-                            break;
+                            return FCMPU;
                         case FLOAT_FCTIWZ:
-                            FCTIWZ(instr);
-                            break;
+                            return FCTIWZ;
                         case FLOAT_MTFSB1:
-                            MTFSB1(instr);
-                            break;
+                            return MTFSB1;
                         case FLOAT_FNEG:
-                            FNEG(instr);
-                            break;
+                            return FNEG;
                         case FLOAT_FMR:
-                            FMR(instr);
-                            break;
+                            return FMR;
                         case FLOAT_MTFSF:
-                            MTFSF(instr);
-                            break;
+                            return MTFSF;
                         default:
-                            printf("Unimplemented Broadway float opcode %u (IA: %08X, instruction: %08X)\n", XO, CIA, instr);
-
-                            exit(1);
+                            return UnimplementedFloat;
                     }
             }
-            break;
         default:
-            printf("Unimplemented Broadway primary opcode %u (IA: %08X, instruction: %08X)\n", OPCD, CIA, instr);
+            return UnimplementedPrimary;
+    }
+}
 
-            exit(1);
+static void ExecInstr(const u32 instr) {
+    DecodeInstr(instr)(instr);
+}
+
+static int IsUnimplemented(const codecache_Handler handler) {
+    return (handler == UnimplementedPairedSingle) ||
+           (handler == UnimplementedSystem) ||
+           (handler == UnimplementedSecondary) ||
+           (handler == UnimplementedFloat) ||
+           (handler == UnimplementedPrimary);
+}
+
+static int IsTranslationSpr(const u32 spr) {
+    return ((spr >= SPR_IBAT0U) && (spr <= SPR_IBAT3L)) ||
+           ((spr >= SPR_IBAT4U) && (spr <= SPR_IBAT7L)) ||
+           ((spr >= SPR_DBAT0U) && (spr <= SPR_DBAT3L)) ||
+           ((spr >= SPR_DBAT4U) && (spr <= SPR_DBAT7L)) ||
+           (spr == SPR_HID4);
+}
+
+static int IsBlockEnd(const codecache_Handler handler, const u32 instr) {
+    if (handler == MTSPR) {
+        // mtlr/mtctr are common in the middle of blocks
+        return IsTranslationSpr(SPR);
     }
+
+    // Branches, exceptions and anything that can change address translation
+    return (handler == B) ||
+           (handler == BC) ||
+           (handler == BCCTR) ||
+           (handler == BCLR) ||
+           (handler == ISYNC) ||
+           (handler == MTMSR) ||
+           (handler == MTSR) ||
+           (handler == MTSRIN) ||
+           (handler == RFI) ||
+           (handler == TLBIE) ||
+           (handler == SC);
 }
 
-static void IncrementTbr() {
-    static int prescaler = 0;
+static int IsBranch(const codecache_Handler handler) {
+    return (handler == B) || (handler == BC) || (handler == BCCTR) || (handler == BCLR);
+}
+
+static int IsCompare(const codecache_Handler handler) {
+    return (handler == CMP) || (handler == CMPI) || (handler == CMPL) || (handler == CMPLI);
+}
 
-    prescaler++;
+static int IsMflr(const codecache_Op* op) {
+    const u32 instr = op->instr;
 
-    if (prescaler >= 12) {
-        prescaler = 0;
+    return (op->handler == MFSPR) && (SPR == SPR_LR);
+}
+
+static void Compare(const codecache_Op* op) {
+    if (op->handler == CMPI) {
+        CMPI(op->instr);
+    } else if (op->handler == CMPLI) {
+        CMPLI(op->instr);
+    } else if (op->handler == CMP) {
+        CMP(op->instr);
+    } else {
+        CMPL(op->instr);
+    }
+}
+
+static void IncrementTbr() {
+    ctx.prescaler++;
+
+    if (ctx.prescaler >= 12) {
+        ctx.prescaler = 0;
 
         TBR++;
     }
 }
 
+// Superinstructions. These start with CIA pointing to the first instruction
+// and IA pointing past the last one, and must leave CIA on the last instruction
+// they executed. Like the interpreter, they stop right after an access that raised an interrupt
+
+static void FusedLisAddi(const codecache_Op* op) {
+    u32 instr = op[0].instr;
+
+    const u32 n = UIMM << 16;
+
+    ctx.r[RD] = n;
+
+    instr = op[1].instr;
+
+    ctx.r[RD] = n + SIMM;
+
+    CIA += sizeof(u32);
+
+#ifdef BROADWAY_DEBUG
+    printf("PPC [%08X] lis+addi r%u, %X; r%u: %08X\n", CIA, RD, n + SIMM, RD, ctx.r[RD]);
+#endif
+}
+
+static void FusedLisOri(const codecache_Op* op) {
+    u32 instr = op[0].instr;
+
+    const u32 n = UIMM << 16;
+
+    ctx.r[RD] = n;
+
+    instr = op[1].instr;
+
+    ctx.r[RA] = n | UIMM;
+
+    CIA += sizeof(u32);
+
+#ifdef BROADWAY_DEBUG
+    printf("PPC [%08X] lis+ori r%u, %X; r%u: %08X\n", CIA, RA, n | UIMM, RA, ctx.r[RA]);
+#endif
+}
+
+static void FusedCompareBranch(const codecache_Op* op) {
+    Compare(&op[0]);
+
+    CIA += sizeof(u32);
+
+    BC(op[1].instr);
+}
+
+static void FusedRlwinmCompare(const codecache_Op* op) {
+    RLWINM(op[0].instr);
+
+    CIA += sizeof(u32);
+
+    Compare(&op[1]);
+}
+
+static void FusedRlwinmCompareBranch(const codecache_Op* op) {
+    RLWINM(op[0].instr);
+
+    CIA += sizeof(u32);
+
+    Compare(&op[1]);
+
+    CIA += sizeof(u32);
+
+    BC(op[2].instr);
+}
+
+static void FusedMflrStw(const codecache_Op* op) {
+    MFSPR(op[0].instr);
+
+    CIA += sizeof(u32);
+
+    STW(op[1].instr);
+}
+
+static void FusedMflrStwStwu(const codecache_Op* op) {
+    MFSPR(op[0].instr);
+
+    CIA += sizeof(u32);
+
+    STW(op[1].instr);
+
+    if (IsInterruptPending()) {
+        IA = CIA + sizeof(u32);
+
+        return;
+    }
+
+    CIA += sizeof(u32);
+
+    STWU(op[2].instr);
+}
+
+static void FusedStwuMflrStw(const codecache_Op* op) {
+    STWU(op[0].instr);
+
+    if (IsInterruptPending()) {
+        IA = CIA + sizeof(u32);
+
+        return;
+    }
+
+    CIA += sizeof(u32);
+
+    MFSPR(op[1].instr);
+
+    CIA += sizeof(u32);
+
+    STW(op[2].instr);
+}
+
+static void FusedDcbzLoop(const codecache_Op* op) {
+    // loop: dcbz rA, rB; addi rB, rB, 32; bdnz loop
+    const u32 instr = op[0].instr;
+
+    if (CTR == 0) {
+        // Would wrap around, run a single iteration the normal way
+        DCBZ(op[0].instr);
+
+        if (IsInterruptPending()) {
+            IA = CIA + sizeof(u32);
+
+            return;
+        }
+
+        CIA += sizeof(u32);
+
+        ADDI(op[1].instr);
+
+        CIA += sizeof(u32);
+
+        BC(op[2].instr);
+
+        return;
+    }
+
+    const u32 start = CIA;
+
+    // Don't run too far past the end of the slice, the rest of the loop runs in the next one
+    u32 count = CTR;
+
+    const i64 maxCount = (ctx.cyclesToRun > 3) ? (ctx.cyclesToRun / 3) : 1;
+
+    if (count > maxCount) {
+        count = maxCount;
+    }
+
+    const u32 iterations = count;
+
+    int interrupted = NOUWII_FALSE;
+
+    while (count > 0) {
+        u32 addr = ctx.r[RB];
+
+        if (RA != 0) {
+            addr += ctx.r[RA];
+        }
+
+        addr &= ~(SIZE_CACHE_BLOCK - 1);
+
+        u32 n = (SIZE_PAGE - (addr & (SIZE_PAGE - 1))) / SIZE_CACHE_BLOCK;
+
+        if (n > count) {
+            n = count;
+        }
+
+        u8* mem = GetSpan(addr, n * SIZE_CACHE_BLOCK, ACCESS_WRITE);
+
+        if (mem != NULL) {
+            memset(mem, 0, n * SIZE_CACHE_BLOCK);
+        } else {
+            // Registers are updated per block, so a fault restarts the loop where it stopped
+            n = 1;
+
+            DCBZ(instr);
+
+            if (IsInterruptPending()) {
+                interrupted = NOUWII_TRUE;
+                break;
+            }
+        }
+
+        ctx.r[RB] += n * SIZE_CACHE_BLOCK;
+
+        CTR -= n;
+
+        count -= n;
+    }
+
+    // The dispatcher accounts for the instructions up to CIA, these are the iterations before
+    const u32 numCycles = (interrupted) ? 3 * (iterations - count) : 3 * (iterations - 1);
+
+    for (u32 i = 0; i < numCycles; i++) {
+        IncrementTbr();
+    }
+
+    ctx.cyclesToRun -= numCycles;
+
+    if (interrupted) {
+        // Stopped on the dcbz
+        CIA = start;
+        IA = start + sizeof(u32);
+    } else {
+        CIA = start + 2 * sizeof(u32);
+
+        if (CTR != 0) {
+            IA = start;
+        }
+    }
+}
+
+static void Fuse(codecache_Op* op, const codecache_FusedHandler fused, const u32 numFused) {
+    op->fused = fused;
+    op->numFused = numFused;
+}
+
+static u32 FuseOps(codecache_Op* ops, const u32 remaining) {
+    // Returns the number of instructions covered by the superinstruction at ops[0]
+    if (remaining < 2) {
+        return 1;
+    }
+
+    const u32 instr0 = ops[0].instr;
+    const u32 instr1 = ops[1].instr;
+
+    const u32 rd0 = GetBits(instr0, 6, 10);
+    const u32 ra0 = GetBits(instr0, 11, 15);
+    const u32 rd1 = GetBits(instr1, 6, 10);
+    const u32 ra1 = GetBits(instr1, 11, 15);
+
+    // dcbz rA, rB; addi rB, rB, 32; bdnz (back to the dcbz)
+    if ((remaining >= 3) && (ops[0].handler == DCBZ) && (ops[1].handler == ADDI) && (ops[2].handler == BC)) {
+        const u32 rb0 = GetBits(instr0, 16, 20);
+        const u32 instr2 = ops[2].instr;
+
+        const int isBdnz = ((GetBits(instr2, 6, 9) & 0xB) == 0x8) && !GetBits(instr2, 30, 31);
+        const int isLoop = (i16)(GetBits(instr2, 16, 29) << 2) == -(i16)(2 * sizeof(u32));
+
+        if ((rd1 == rb0) && (ra1 == rb0) && (rb0 != 0) && (ra0 != rb0) && ((i16)GetBits(instr1, 16, 31) == SIZE_CACHE_BLOCK) && isBdnz && isLoop) {
+            Fuse(ops, FusedDcbzLoop, 3);
+
+            return 3;
+        }
+    }
+
+    // lis rD, hi; addi rX, rD, lo
+    if ((ops[0].handler == ADDIS) && (ra0 == 0) && (ops[1].handler == ADDI) && (ra1 == rd0) && (ra1 != 0)) {
+        Fuse(ops, FusedLisAddi, 2);
+
+        return 2;
+    }
+
+    // lis rD, hi; ori rX, rD, lo
+    if ((ops[0].handler == ADDIS) && (ra0 == 0) && (ops[1].handler == ORI) && (rd1 == rd0)) {
+        Fuse(ops, FusedLisOri, 2);
+
+        return 2;
+    }
+
+    // cmp(l)(w)(i) crfD, ...; bc
+    if (IsCompare(ops[0].handler) && (ops[1].handler == BC)) {
+        Fuse(ops, FusedCompareBranch, 2);
+
+        return 2;
+    }
+
+    // rlwinm rA, rS, ...; cmp(l)wi crfD, rA, imm; (bc)
+    if ((ops[0].handler == RLWINM) && ((ops[1].handler == CMPI) || (ops[1].handler == CMPLI)) && (ra1 == ra0)) {
+        if ((remaining >= 3) && (ops[2].handler == BC)) {
+            Fuse(ops, FusedRlwinmCompareBranch, 3);
+
+            return 3;
+        }
+
+        Fuse(ops, FusedRlwinmCompare, 2);
+
+        return 2;
+    }
+
+    // mflr rD; stw rD, d(rA); (stwu rS, d(rA))
+    if (IsMflr(&ops[0]) && (ops[1].handler == STW) && (rd1 == rd0)) {
+        if ((remaining >= 3) && (ops[2].handler == STWU)) {
+            Fuse(ops, FusedMflrStwStwu, 3);
+
+            return 3;
+        }
+
+        Fuse(ops, FusedMflrStw, 2);
+
+        return 2;
+    }
+
+    // stwu rS, d(rA); mflr rD; stw rD, d(rA)
+    if ((remaining >= 3) && (ops[0].handler == STWU) && IsMflr(&ops[1]) && (ops[2].handler == STW) && (GetBits(ops[2].instr, 6, 10) == rd1)) {
+        Fuse(ops, FusedStwuMflrStw, 3);
+
+        return 3;
+    }
+
+    return 1;
+}
+
+#ifdef BROADWAY_VERIFY_FUSION
+static void VerifyFusedOp(const codecache_Op* op) {
+    // Run the unfused sequence on a copy of the context and compare the results
+    const Context saved = ctx;
+
+    IA += op->numFused * sizeof(u32);
+
+    for (u32 i = 0; i < op->numFused; i++) {
+        CIA = saved.ia + i * sizeof(u32);
+
+        op[i].handler(op[i].instr);
+    }
+
+    const Context unfused = ctx;
+
+    ctx = saved;
+
+    CIA = IA;
+    IA += op->numFused * sizeof(u32);
+
+    op->fused(op);
+
+    if (memcmp(&ctx, &unfused, sizeof(ctx)) != 0) {
+        printf("Broadway Superinstruction mismatch (IA: %08X, instruction: %08X)\n", saved.ia, op->instr);
+
+        exit(1);
+    }
+}
+#endif
+
+// Returns NOUWII_TRUE if the block ran up to and including its last op
+static int RunBlock(const codecache_Block* block) {
+    for (u32 i = 0; i < block->numOps; i++) {
+        if (ctx.cyclesToRun <= 0) {
+            return NOUWII_FALSE;
+        }
+
+        const codecache_Op* op = &block->ops[i];
+
+        if ((op->fused != NULL) && (ctx.cyclesToRun >= op->numFused)) {
+            const u32 start = IA;
+
+#ifdef BROADWAY_VERIFY_FUSION
+            VerifyFusedOp(op);
+#else
+            CIA = IA;
+            IA += op->numFused * sizeof(u32);
+
+            op->fused(op);
+#endif
+
+            // Fewer than numFused if an interrupt stopped it
+            const u32 numExecuted = (CIA - start) / sizeof(u32) + 1;
+
+            for (u32 j = 0; j < numExecuted; j++) {
+                IncrementTbr();
+            }
+
+            ctx.cyclesToRun -= numExecuted;
+
+            i += op->numFused - 1;
+
+            if (IsInterruptPending()) {
+                // Raised by an I/O access, taken after it like in the interpreter
+                return NOUWII_FALSE;
+            }
+
+            if (IA != (CIA + sizeof(op->instr))) {
+                return i == (block->numOps - 1);
+            }
+
+            continue;
+        }
+
+        CIA = IA;
+        IA += sizeof(op->instr);
+
+        op->handler(op->instr);
+
+        IncrementTbr();
+
+        ctx.cyclesToRun--;
+
+        if (IA != (CIA + sizeof(op->instr))) {
+            // Taken branch or exception
+            return i == (block->numOps - 1);
+        }
+
+        if (IsInterruptPending()) {
+            // Raised by an I/O access, taken after it like in the interpreter
+            return NOUWII_FALSE;
+        }
+    }
+
+    return NOUWII_TRUE;
+}
+
+// Goes through the block's trampoline if it has one, host profilers then see which block runs
+static int CallBlock(const codecache_Block* block) {
+    return (block->trampoline != NULL) ? block->trampoline(block) : RunBlock(block);
+}
+
+// Returns the block whose links lead to the next block
+static codecache_Block* GetExitOwner(codecache_Block* block) {
+    if (IA == (CIA + sizeof(u32))) {
+        return block;
+    }
+
+    const codecache_Op* last = &block->ops[block->numOps - 1];
+
+    codecache_Block* owner = block;
+
+    if (last->handler == BCLR) {
+        // Returns continue at the fall-through of the predicted caller
+        owner = codecache_PopReturn(IA);
+    }
+
+    if (IsBranch(last->handler) && ((last->instr & 1) != 0)) {
+        codecache_PushReturn(block, CIA + sizeof(u32));
+    }
+
+    return owner;
+}
+
+static void RunInterpreter(const u32 addr) {
+    const i64 cyclesToRun = ctx.cyclesToRun;
+
+    // Interpret until the next change in control flow
+    do {
+        const u32 instr = FetchInstr();
+
+        ExecInstr(instr);
+
+        IncrementTbr();
+
+        ctx.cyclesToRun--;
+    } while ((ctx.cyclesToRun > 0) && (IA == (CIA + sizeof(u32))) && !IsInterruptPending());
+
+    // Every block is interpreted before it gets compiled, so this sees all code that runs
+    coverage_Mark(addr, (u32)(cyclesToRun - ctx.cyclesToRun));
+}
+
+static int IsPageSet(const u64* bitmap, const u32 ramPage) {
+    return (bitmap[ramPage / 64] & ((u64)1 << (ramPage & 63))) != 0;
+}
+
+// Returns the first set page at or after ramPage, or MEMORY_NUM_RAM_PAGES if there is none
+static u32 GetNextPage(const u64* bitmap, const u32 ramPage) {
+    for (u32 word = ramPage / 64; word < MEMORY_SIZE_DIRTY_BITMAP; word++) {
+        u64 bits = bitmap[word];
+
+        if (word == (ramPage / 64)) {
+            bits &= ~(u64)0 << (ramPage & 63);
+        }
+
+        if (bits != 0) {
+            return 64 * word + __builtin_ctzll(bits);
+        }
+    }
+
+    return MEMORY_NUM_RAM_PAGES;
+}
+
+static void SyncShadow() {
+    Lockstep* lockstep = ctx.lockstep;
+
+    u64* dirty = lockstep->dirtyBlock;
+
+    // Catches writes from outside the CPU since the last block
+    memory_CollectDirty(MEMORY_DIRTY_LOCKSTEP, dirty);
+
+    if (!lockstep->synced) {
+        memset(dirty, 0xFF, sizeof(lockstep->dirtyBlock));
+
+        lockstep->synced = NOUWII_TRUE;
+    }
+
+    for (u32 ramPage = GetNextPage(dirty, 0); ramPage < MEMORY_NUM_RAM_PAGES; ramPage = GetNextPage(dirty, ramPage + 1)) {
+        memcpy(&lockstep->shadow[MEMORY_SIZE_PAGE * ramPage], memory_GetRamPage(ramPage), MEMORY_SIZE_PAGE);
+    }
+}
+
+// Runs the block, storage exceptions end it early instead of unwinding to broadway_Run
+static int RunBlockGuarded(const codecache_Block* block) {
+    jmp_buf fault;
+    memcpy(fault, ctx.fault, sizeof(fault));
+
+    volatile int completed = NOUWII_FALSE;
+
+    if (setjmp(ctx.fault) == 0) {
+        completed = CallBlock(block);
+    }
+
+    memcpy(ctx.fault, fault, sizeof(fault));
+
+    return completed;
+}
+
+// Interprets instructions until cyclesToRun drops to the given count, or a storage exception is taken
+static void RunInterpreterGuarded(const i64 cyclesToRun) {
+    jmp_buf fault;
+    memcpy(fault, ctx.fault, sizeof(fault));
+
+    if (setjmp(ctx.fault) == 0) {
+        while (ctx.cyclesToRun > cyclesToRun) {
+            const u32 instr = FetchInstr();
+
+            ExecInstr(instr);
+
+            IncrementTbr();
+
+            ctx.cyclesToRun--;
+        }
+    }
+
+    memcpy(ctx.fault, fault, sizeof(fault));
+}
+
+static void DumpState(const char* name, const Context* state) {
+    printf("Lockstep %s: IA: %08X, CIA: %08X, cycles left: %lld\n", name, state->ia, state->cia, (long long)state->cyclesToRun);
+    printf("Lockstep %s: CR: %08X, XER: %08X, LR: %08X, CTR: %08X, MSR: %08X, FPSCR: %08X\n", name, state->cr, state->sprs.xer.raw, state->sprs.lr, state->sprs.ctr, state->msr.raw, state->fpscr);
+    printf("Lockstep %s: SRR0: %08X, SRR1: %08X, DAR: %08X, DSISR: %08X\n", name, state->sprs.srr0, state->sprs.srr1.raw, state->sprs.dar, state->sprs.dsisr);
+
+    for (int i = 0; i < NUM_GPRS; i++) {
+        printf("Lockstep %s: r%-2d %08X  f%-2d %016llX %016llX\n", name, i, state->r[i], i, (unsigned long long)state->fprs[i].raw[0], (unsigned long long)state->fprs[i].raw[1]);
+    }
+}
+
+static _Noreturn void Diverge(const codecache_Block* block, const char* reason) {
+    const Lockstep* lockstep = ctx.lockstep;
+
+    printf("Lockstep Divergence in block %08X (IA: %08X, %u ops): %s\n", block->addr, lockstep->saved.ia, block->numOps, reason);
+
+    for (u32 i = 0; i < block->numOps; i++) {
+        const codecache_Op* op = &block->ops[i];
+
+        printf("Lockstep   %08X: %08X%s\n", lockstep->saved.ia + i * (u32)sizeof(u32), op->instr, (op->fused != NULL) ? " (fused)" : "");
+    }
+
+    DumpState("Before", &lockstep->saved);
+    DumpState("Block", &lockstep->block);
+    DumpState("Interpreter", &ctx);
+
+    exit(1);
+}
+
+static void CompareStates(const codecache_Block* block) {
+    const Context* a = &ctx.lockstep->block;
+    const Context* b = &ctx;
+
+    if ((a->ia != b->ia) || (a->cyclesToRun != b->cyclesToRun)) {
+        Diverge(block, "control flow");
+    }
+
+    if (memcmp(a->r, b->r, sizeof(a->r)) != 0) {
+        Diverge(block, "GPRs");
+    }
+
+    if (memcmp(a->fprs, b->fprs, sizeof(a->fprs)) != 0) {
+        Diverge(block, "FPRs");
+    }
+
+    if ((a->cr != b->cr) || (a->fpscr != b->fpscr)) {
+        Diverge(block, "CR/FPSCR");
+    }
+
+    if (a->msr.raw != b->msr.raw) {
+        Diverge(block, "MSR");
+    }
+
+    if (memcmp(&a->sprs, &b->sprs, sizeof(a->sprs)) != 0) {
+        Diverge(block, "SPRs");
+    }
+
+    if (memcmp(a->lockedCache, b->lockedCache, sizeof(a->lockedCache)) != 0) {
+        Diverge(block, "locked cache");
+    }
+}
+
+static void ComparePages(const codecache_Block* block) {
+    Lockstep* lockstep = ctx.lockstep;
+
+    u64* dirty = lockstep->dirtyInterpreter;
+
+    // Pages written by either side
+    for (u32 word = 0; word < MEMORY_SIZE_DIRTY_BITMAP; word++) {
+        dirty[word] |= lockstep->dirtyBlock[word];
+    }
+
+    for (u32 ramPage = GetNextPage(dirty, 0); ramPage < MEMORY_NUM_RAM_PAGES; ramPage = GetNextPage(dirty, ramPage + 1)) {
+        const u8* expected = IsPageSet(lockstep->dirtyBlock, ramPage) ? lockstep->result : lockstep->shadow;
+        const u8* mem = memory_GetRamPage(ramPage);
+
+        expected = &expected[MEMORY_SIZE_PAGE * ramPage];
+
+        if (memcmp(expected, mem, MEMORY_SIZE_PAGE) != 0) {
+            u32 offset = 0;
+
+            while (expected[offset] == mem[offset]) {
+                offset++;
+            }
+
+            printf("Lockstep Memory at %08X: block wrote %02X, interpreter wrote %02X\n", memory_GetRamPageAddr(ramPage) + offset, expected[offset], mem[offset]);
+
+            Diverge(block, "memory");
+        }
+
+        // Both agree, this is the new shadow
+        memcpy(&lockstep->shadow[MEMORY_SIZE_PAGE * ramPage], mem, MEMORY_SIZE_PAGE);
+    }
+}
+
+static int RunBlockLockstep(const codecache_Block* block) {
+    Lockstep* lockstep = ctx.lockstep;
+
+    SyncShadow();
+
+    const u64 numIoAccesses = memory_GetNumIoAccesses();
+
+    lockstep->saved = ctx;
+
+    const int completed = RunBlockGuarded(block);
+
+    if ((memory_GetNumIoAccesses() != numIoAccesses) || (ctx.numDmas != lockstep->saved.numDmas)) {
+        // Side effects outside of RAM, the next sync picks up the written pages
+        lockstep->numSkipped++;
+
+        return completed;
+    }
+
+    lockstep->block = ctx;
+
+    // Set the block's writes aside and roll RAM back
+    memory_CollectDirty(MEMORY_DIRTY_LOCKSTEP, lockstep->dirtyBlock);
+
+    const u64* dirty = lockstep->dirtyBlock;
+
+    for (u32 ramPage = GetNextPage(dirty, 0); ramPage < MEMORY_NUM_RAM_PAGES; ramPage = GetNextPage(dirty, ramPage + 1)) {
+        u8* mem = memory_GetRamPage(ramPage);
+
+        memcpy(&lockstep->result[MEMORY_SIZE_PAGE * ramPage], mem, MEMORY_SIZE_PAGE);
+        memcpy(mem, &lockstep->shadow[MEMORY_SIZE_PAGE * ramPage], MEMORY_SIZE_PAGE);
+
+        // Compiled code may depend on the old contents
+        memory_UnprotectCode(memory_GetRamPageAddr(ramPage));
+    }
+
+    ctx = lockstep->saved;
+
+    RunInterpreterGuarded(lockstep->block.cyclesToRun);
+
+    memory_CollectDirty(MEMORY_DIRTY_LOCKSTEP, lockstep->dirtyInterpreter);
+
+    CompareStates(block);
+    ComparePages(block);
+
+    lockstep->numChecked++;
+
+    return completed;
+}
+
 void broadway_Initialize() {
+    instance_CreateContext(INSTANCE_BROADWAY, sizeof(Context));
 
+    codecache_SetRunner(RunBlock);
 }
 
 void broadway_Reset() {
+    // Lockstep buffers are host state and survive resets
+    Lockstep* lockstep = ctx.lockstep;
+
     memset(&ctx, 0, sizeof(ctx));
+
+    ctx.lockstep = lockstep;
+
+    if (lockstep != NULL) {
+        lockstep->synced = NOUWII_FALSE;
+    }
+
+    UpdateSegments();
 }
 
 void broadway_Shutdown() {
+    Lockstep* lockstep = ctx.lockstep;
+
+    if (lockstep != NULL) {
+        printf("Lockstep %llu blocks checked, %llu skipped\n", (unsigned long long)lockstep->numChecked, (unsigned long long)lockstep->numSkipped);
 
+        free(lockstep->shadow);
+        free(lockstep->result);
+        free(lockstep);
+    }
+
+    instance_DestroyContext(INSTANCE_BROADWAY);
 }
 
-void broadway_Run() {
-    for (; ctx.cyclesToRun > 0; ctx.cyclesToRun--) {
-        const u32 instr = FetchInstr();
+void broadway_SetConfig(const int lockstep) {
+    if (!lockstep || (ctx.lockstep != NULL)) {
+        return;
+    }
 
-        ExecInstr(instr);
+    ctx.lockstep = calloc(1, sizeof(Lockstep));
 
-        IncrementTbr();
+    if (ctx.lockstep != NULL) {
+        // Only the pages that are touched get backed
+        ctx.lockstep->shadow = calloc(MEMORY_NUM_RAM_PAGES, MEMORY_SIZE_PAGE);
+        ctx.lockstep->result = calloc(MEMORY_NUM_RAM_PAGES, MEMORY_SIZE_PAGE);
+    }
+
+    if ((ctx.lockstep == NULL) || (ctx.lockstep->shadow == NULL) || (ctx.lockstep->result == NULL)) {
+        printf("Broadway Failed to allocate lockstep buffers\n");
+        exit(1);
     }
 }
 
+static void Dispatch() {
+    // Last block that ran to completion, only valid until the next lookup
+    codecache_Block* prev = NULL;
+
+    while (ctx.cyclesToRun > 0) {
+        codecache_Block* owner = NULL;
+        codecache_Block* block = NULL;
+
+        if (IsInterruptPending()) {
+            DeliverInterrupt();
+
+            // Don't link the previous block to the exception vector
+            prev = NULL;
+        }
+
+        if (prev != NULL) {
+            owner = GetExitOwner(prev);
+        }
+
+        if (owner != NULL) {
+            block = codecache_GetLink(owner, IA);
+        }
+
+        u32 addr = 0;
+
+        if (block == NULL) {
+            const u32 epoch = codecache_GetEpoch();
+
+            addr = Translate(IA, ACCESS_CODE);
+
+            block = codecache_Lookup(addr);
+
+            // Evictions during the lookup may have freed the owner
+            if ((block != NULL) && (owner != NULL) && (codecache_GetEpoch() == epoch)) {
+                const int link = ((owner != prev) || (IA == (CIA + sizeof(u32)))) ? CODECACHE_LINK_FALLTHROUGH : CODECACHE_LINK_TAKEN;
+
+                codecache_SetLink(owner, link, IA, block);
+            }
+        }
+
+        if ((block != NULL) && (ctx.lockstep != NULL)) {
+            prev = RunBlockLockstep(block) ? block : NULL;
+        } else if (block != NULL) {
+            prev = CallBlock(block) ? block : NULL;
+        } else {
+            RunInterpreter(addr);
+
+            prev = NULL;
+        }
+    }
+}
+
+void broadway_Run() {
+    // Unmapped accesses outside of the CPU are still fatal
+    memory_SetFaultHandler(MemoryFault);
+    memory_SetWatchHandler(MemoryWatch);
+
+    // Storage exceptions unwind to here once they have been delivered
+    setjmp(ctx.fault);
+
+    Dispatch();
+
+    memory_SetFaultHandler(NULL);
+    memory_SetWatchHandler(NULL);
+}
+
 void broadway_SetEntry(const u32 addr) {
     IA = addr;
 }
 
-void broadway_TryInterrupt() {
-    if (MSR.ee != 0) {
-        ExternalInterrupt();
-    }
+u32 broadway_GetCia() {
+    return CIA;
+}
+
+u32 broadway_GetLr() {
+    return LR;
+}
+
+void broadway_SetInterruptPending() {
+    atomic_store_explicit(&ctx.interruptPending, NOUWII_TRUE, memory_order_relaxed);
 }
 
 i64* broadway_GetCyclesToRun() {
     return &ctx.cyclesToRun;
 }
+
+codecache_Block* broadway_CompileBlock(const u8* code, const u32 maxInstrs) {
+    assert(maxInstrs <= CODECACHE_MAX_INSTRS);
+
+    codecache_Op ops[CODECACHE_MAX_INSTRS];
+
+    u32 numOps = 0;
+
+    while (numOps < maxInstrs) {
+        u32 instr;
+        memcpy(&instr, &code[sizeof(instr) * numOps], sizeof(instr));
+
+        instr = common_Bswap32(instr);
+
+        const codecache_Handler handler = DecodeInstr(instr);
+
+        if (IsUnimplemented(handler)) {
+            // Leave these to the interpreter
+            break;
+        }
+
+        ops[numOps].handler = handler;
+        ops[numOps].fused = NULL;
+        ops[numOps].instr = instr;
+        ops[numOps].numFused = 1;
+
+        numOps++;
+
+        if (IsBlockEnd(handler, instr)) {
+            break;
+        }
+    }
+
+    if (numOps == 0) {
+        return NULL;
+    }
+
+    // Peephole pass, superinstructions never overlap
+    for (u32 i = 0; i < numOps;) {
+        i += FuseOps(&ops[i], numOps - i);
+    }
+
+    codecache_Block* block = malloc(sizeof(codecache_Block) + numOps * sizeof(codecache_Op));
+
+    memset(block, 0, sizeof(codecache_Block));
+
+    block->numOps = numOps;
+
+    memcpy(block->ops, ops, numOps * sizeof(codecache_Op));
+
+    return block;
+}
+
+void broadway_GetState(broadway_State* state) {
+    state->ia = IA;
+
+    memcpy(state->r, ctx.r, sizeof(state->r));
+
+    for (int i = 0; i < NUM_FPRS; i++) {
+        state->fprs[i][0] = ctx.fprs[i].raw[0];
+        state->fprs[i][1] = ctx.fprs[i].raw[1];
+    }
+
+    state->cr = CR;
+    state->fpscr = FPSCR;
+    state->xer = XER.raw;
+    state->lr = LR;
+    state->ctr = CTR;
+    state->msr = ctx.msr.raw;
+    state->hid2 = HID2.raw;
+    state->tbr = ctx.sprs.tbr.raw;
+}
+
+void broadway_SetState(const broadway_State* state) {
+    IA = state->ia;
+
+    memcpy(ctx.r, state->r, sizeof(ctx.r));
+
+    for (int i = 0; i < NUM_FPRS; i++) {
+        ctx.fprs[i].raw[0] = state->fprs[i][0];
+        ctx.fprs[i].raw[1] = state->fprs[i][1];
+    }
+
+    CR = state->cr;
+    FPSCR = state->fpscr;
+    XER.raw = state->xer;
+    LR = state->lr;
+    CTR = state->ctr;
+    ctx.msr.raw = state->msr;
+    HID2.raw = state->hid2;
+    ctx.sprs.tbr.raw = state->tbr;
+
+    // The time base starts a new prescaler period
+    ctx.prescaler = 0;
+}
+
+int broadway_Execute(const u32 instr) {
+    const codecache_Handler handler = DecodeInstr(instr);
+
+    if (IsUnimplemented(handler)) {
+        return NOUWII_FALSE;
+    }
+
+    CIA = IA;
+    IA += sizeof(instr);
+
+    handler(instr);
+
+    return NOUWII_TRUE;
+}
+
+void broadway_Interpret(const i64 numInstrs) {
+    ctx.cyclesToRun = numInstrs;
+
+    RunInterpreterGuarded(0);
+}
+
+int broadway_RunBlock(const codecache_Block* block, const i64 cyclesToRun) {
+    ctx.cyclesToRun = cyclesToRun;
+
+    return RunBlockGuarded(block);
+}
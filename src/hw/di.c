@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "core/instance.h"
+
 #define MAKEFUNC_DI_READIO(size)                                     \
 u##size di_ReadIo##size(const u32 addr) {                            \
     printf("DI Unimplemented read%d (address: %08X)\n", size, addr); \
@@ -32,10 +34,10 @@ typedef struct Context {
     
 } Context;
 
-static Context ctx;
+#define ctx INSTANCE_CONTEXT(INSTANCE_DI, Context)
 
 void di_Initialize() {
-
+    instance_CreateContext(INSTANCE_DI, sizeof(Context));
 }
 
 void di_Reset() {
@@ -43,7 +45,7 @@ void di_Reset() {
 }
 
 void di_Shutdown() {
-
+    instance_DestroyContext(INSTANCE_DI);
 }
 
 MAKEFUNC_DI_READIO(8)
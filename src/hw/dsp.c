@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "core/instance.h"
+
 #define NUM_MAILBOXES (2)
 
 #define MASK_CONTROL (0x0957)
@@ -117,10 +119,10 @@ typedef struct Context {
     } dmasize;
 } Context;
 
-static Context ctx;
+#define ctx INSTANCE_CONTEXT(INSTANCE_DSP, Context)
 
 void dsp_Initialize() {
-
+    instance_CreateContext(INSTANCE_DSP, sizeof(Context));
 }
 
 void dsp_Reset() {
@@ -128,7 +130,7 @@ void dsp_Reset() {
 }
 
 void dsp_Shutdown() {
-
+    instance_DestroyContext(INSTANCE_DSP);
 }
 
 MAKEFUNC_DSP_READIO(8)
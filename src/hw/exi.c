@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "core/instance.h"
+
 #define NUM_CHANNELS (3)
 
 #define SIZE_CHANNEL (0x14)
@@ -75,18 +77,22 @@ typedef struct Channel {
     u32 data;
 } Channel;
 
-static Channel chns[NUM_CHANNELS];
+typedef struct Context {
+    Channel chns[NUM_CHANNELS];
+} Context;
 
-void exi_Initialize() {
+#define ctx INSTANCE_CONTEXT(INSTANCE_EXI, Context)
 
+void exi_Initialize() {
+    instance_CreateContext(INSTANCE_EXI, sizeof(Context));
 }
 
 void exi_Reset() {
-    memset(chns, 0, sizeof(chns));
+    memset(&ctx, 0, sizeof(ctx));
 }
 
 void exi_Shutdown() {
-
+    instance_DestroyContext(INSTANCE_EXI);
 }
 
 MAKEFUNC_EXI_READIO(8)
@@ -96,7 +102,7 @@ MAKEFUNC_EXI_READIO(64)
 u32 exi_ReadIo32(const u32 addr) {
     const int c = (addr - EXI_CSR) / SIZE_CHANNEL;
 
-    Channel* chn = &chns[c];
+    Channel* chn = &ctx.chns[c];
 
     switch (EXI_CSR + ((addr - EXI_CSR) % SIZE_CHANNEL)) {
         case EXI_CSR:
@@ -133,7 +139,7 @@ MAKEFUNC_EXI_WRITEIO(64)
 void exi_WriteIo32(const u32 addr, const u32 data) {
     const int c = (addr - EXI_CSR) / SIZE_CHANNEL;
 
-    Channel* chn = &chns[c];
+    Channel* chn = &ctx.chns[c];
 
     switch (EXI_CSR + ((addr - EXI_CSR) % SIZE_CHANNEL)) {
         case EXI_CSR:
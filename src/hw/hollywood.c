@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "core/instance.h"
+
 #include "hw/ipc.h"
 #include "hw/pi.h"
 
@@ -41,7 +43,7 @@ typedef struct Context {
     u32 ppcirqmask;
 } Context;
 
-static Context ctx;
+#define ctx INSTANCE_CONTEXT(INSTANCE_HOLLYWOOD, Context)
 
 static void CheckPiInterrupt() {
     if ((PPCIRQFLAG & PPCIRQMASK) != 0) {
@@ -52,7 +54,7 @@ static void CheckPiInterrupt() {
 }
 
 void hollywood_Initialize() {
-
+    instance_CreateContext(INSTANCE_HOLLYWOOD, sizeof(Context));
 }
 
 void hollywood_Reset() {
@@ -60,7 +62,7 @@ void hollywood_Reset() {
 }
 
 void hollywood_Shutdown() {
-
+    instance_DestroyContext(INSTANCE_HOLLYWOOD);
 }
 
 void hollywood_AssertIrq(const u32 irqn) {
@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include "core/hle.h"
+#include "core/instance.h"
 
 #include "hw/hollywood.h"
 
@@ -45,7 +46,7 @@ typedef struct Context {
     } ppcctrl;
 } Context;
 
-static Context ctx;
+#define ctx INSTANCE_CONTEXT(INSTANCE_IPC, Context)
 
 static void CheckHwInterrupt() {
     if (((PPCCTRL.y1 != 0) && (PPCCTRL.iy1 != 0)) ||
@@ -55,7 +56,7 @@ static void CheckHwInterrupt() {
 }
 
 void ipc_Initialize() {
-
+    instance_CreateContext(INSTANCE_IPC, sizeof(Context));
 }
 
 void ipc_Reset() {
@@ -63,7 +64,7 @@ void ipc_Reset() {
 }
 
 void ipc_Shutdown() {
-
+    instance_DestroyContext(INSTANCE_IPC);
 }
 
 void ipc_CommandAcknowledged() {
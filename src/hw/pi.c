@@ -10,6 +10,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "core/instance.h"
+
 #include "hw/broadway.h"
 
 #define CONSOLE_TYPE (2 << 28)
@@ -41,10 +43,10 @@ typedef struct Context {
     u32 intmask;
 } Context;
 
-static Context ctx;
+#define ctx INSTANCE_CONTEXT(INSTANCE_PI, Context)
 
 void pi_Initialize() {
-
+    instance_CreateContext(INSTANCE_PI, sizeof(Context));
 }
 
 void pi_Reset() {
@@ -52,7 +54,7 @@ void pi_Reset() {
 }
 
 void pi_Shutdown() {
-
+    instance_DestroyContext(INSTANCE_PI);
 }
 
 void pi_AssertIrq(const u32 irqn) {
@@ -63,7 +65,7 @@ void pi_AssertIrq(const u32 irqn) {
     INTFLAG |= 1 << irqn;
 
     if (pi_IsIrqAsserted()) {
-        broadway_TryInterrupt();
+        broadway_SetInterruptPending();
     }
 }
 
@@ -132,6 +134,6 @@ void pi_WriteIo32(const u32 addr, const u32 data) {
     }
 
     if (pi_IsIrqAsserted()) {
-        broadway_TryInterrupt();
+        broadway_SetInterruptPending();
     }
 }
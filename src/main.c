@@ -0,0 +1,93 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common/config.h"
+
+#include "nouwii.h"
+
+// Guest cycles between profiler samples
+#define PROFILE_INTERVAL (10000)
+
+static nouwii_Instance* instance;
+
+static const char* pathProfile;
+static const char* pathCoverage;
+
+static void WriteReports() {
+    // Emulation usually ends with exit()
+    if (pathProfile != NULL) {
+        nouwii_WriteProfile(instance, pathProfile);
+    }
+
+    if (pathCoverage != NULL) {
+        nouwii_WriteCoverage(instance, pathCoverage);
+    }
+}
+
+static void PrintUsage() {
+    puts("Usage: nouwii [-c coverage output] [-l] [-m] [-p profile output] [-s stats interval] [-r record log | -R replay log] [path to DOL]");
+}
+
+int main(int argc, char** argv) {
+    common_Config config = {};
+
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:lmp:r:R:s:")) != -1) {
+        switch (opt) {
+            case 'c':
+                pathCoverage = optarg;
+
+                config.coverage = NOUWII_TRUE;
+                break;
+            case 'l':
+                config.lockstep = NOUWII_TRUE;
+                break;
+            case 'm':
+                config.perfMap = NOUWII_TRUE;
+                break;
+            case 'p':
+                pathProfile = optarg;
+
+                config.profileInterval = PROFILE_INTERVAL;
+                break;
+            case 'r':
+                config.pathRecord = optarg;
+                break;
+            case 'R':
+                config.pathReplay = optarg;
+                break;
+            case 's':
+                config.statsInterval = strtoll(optarg, NULL, 0);
+                break;
+            default:
+                PrintUsage();
+                return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        PrintUsage();
+        return 1;
+    }
+
+    config.pathDol = argv[optind];
+
+    instance = nouwii_Initialize(&config);
+
+    if ((pathProfile != NULL) || (pathCoverage != NULL)) {
+        atexit(WriteReports);
+    }
+
+    nouwii_Reset(instance);
+    nouwii_Run(instance);
+    nouwii_Shutdown(instance);
+
+    return 0;
+}
@@ -6,16 +6,26 @@
 #include "nouwii.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "common/config.h"
 
+#include "core/codecache.h"
+#include "core/coverage.h"
 #include "core/dev_di.h"
 #include "core/es.h"
 #include "core/fs.h"
 #include "core/hle.h"
+#include "core/hostio.h"
+#include "core/instance.h"
 #include "core/loader.h"
 #include "core/memory.h"
+#include "core/profiler.h"
+#include "core/replay.h"
+#include "core/rewind.h"
 #include "core/scheduler.h"
+#include "core/stats.h"
 
 #include "hw/ai.h"
 #include "hw/broadway.h"
@@ -29,8 +39,6 @@
 #include "hw/si.h"
 #include "hw/vi.h"
 
-#define NUM_ARGS (1 + 1)
-
 static void InitializeGlobals() {
     // Values taken from a MEM1 dump after IOS boot
     memory_Write32(0x0028, 0x01800000); // Memory size
@@ -63,10 +71,22 @@ static void InitializeGlobals() {
     memory_Write32(0x3164, 0x00000001); // GC mode (why is this 1?)
 }
 
-void nouwii_Initialize(const common_Config* config) {
+nouwii_Instance* nouwii_Initialize(const common_Config* config) {
+    nouwii_Instance* instance = instance_Create();
+
+    instance_MakeCurrent(instance);
+
     scheduler_Initialize();
     memory_Initialize();
+    codecache_Initialize();
+    coverage_Initialize();
     hle_Initialize();
+    hostio_Initialize();
+    loader_Initialize();
+    profiler_Initialize();
+    replay_Initialize();
+    rewind_Initialize();
+    stats_Initialize();
 
     dev_di_Initialize();
     es_Initialize();
@@ -85,12 +105,34 @@ void nouwii_Initialize(const common_Config* config) {
     vi_Initialize();
 
     loader_SetDolPath(config->pathDol);
+    rewind_SetConfig(config->rewindInterval, config->rewindBudget);
+    profiler_SetConfig(config->profileInterval);
+    stats_SetConfig(config->statsInterval);
+    codecache_SetConfig(config->perfMap);
+    replay_SetConfig(config->pathRecord, config->pathReplay);
+    broadway_SetConfig(config->lockstep);
+    coverage_SetConfig(config->coverage);
+
+    if ((config->profileInterval != 0) || config->perfMap) {
+        profiler_LoadSymbols(config->pathDol);
+    }
+
+    return instance;
 }
 
-void nouwii_Reset() {
+void nouwii_Reset(nouwii_Instance* instance) {
+    instance_MakeCurrent(instance);
+
     scheduler_Reset();
     memory_Reset();
+    codecache_Reset();
+    coverage_Reset();
     hle_Reset();
+    hostio_Reset();
+    profiler_Reset();
+    replay_Reset();
+    rewind_Reset();
+    stats_Reset();
 
     dev_di_Reset();
     es_Reset();
@@ -118,10 +160,23 @@ void nouwii_Reset() {
     hollywood_WriteIo32(0xD000034, 1 << HOLLYWOOD_IRQ_BROADWAY_IPC);
 }
 
-void nouwii_Shutdown() {
+void nouwii_Shutdown(nouwii_Instance* instance) {
+    instance_MakeCurrent(instance);
+
+    // Stop the code cache worker before the memory it reads goes away
+    codecache_Shutdown();
+
+    // Likewise for the host I/O workers and the files they use
+    hostio_Shutdown();
     scheduler_Shutdown();
     memory_Shutdown();
+    coverage_Shutdown();
     hle_Shutdown();
+    loader_Shutdown();
+    profiler_Shutdown();
+    replay_Shutdown();
+    rewind_Shutdown();
+    stats_Shutdown();
 
     dev_di_Shutdown();
     es_Shutdown();
@@ -138,27 +193,73 @@ void nouwii_Shutdown() {
     pi_Shutdown();
     si_Shutdown();
     vi_Shutdown();
+
+    instance_Destroy(instance);
 }
 
-void nouwii_Run() {
+void nouwii_Run(nouwii_Instance* instance) {
+    instance_MakeCurrent(instance);
+
     while (NOUWII_TRUE) {
         scheduler_Run();
     }
 }
 
-int main(int argc, char** argv) {
-    if (argc < NUM_ARGS) {
-        puts("Usage: nouwii [path to DOL]");
-        return 1;
+void nouwii_RunCycles(nouwii_Instance* instance, const i64 cycles) {
+    instance_MakeCurrent(instance);
+
+    const i64 end = scheduler_GetTimestamp() + cycles;
+
+    while (scheduler_GetTimestamp() < end) {
+        scheduler_Run();
     }
+}
+
+void nouwii_Capture(nouwii_Instance* instance) {
+    instance_MakeCurrent(instance);
+
+    rewind_Capture();
+}
+
+int nouwii_StepBack(nouwii_Instance* instance) {
+    instance_MakeCurrent(instance);
+
+    if (!rewind_StepBack()) {
+        return NOUWII_FALSE;
+    }
+
+    // The rewound HLE state only knows its own transfers, they are redone when claimed
+    hostio_CancelAll();
+
+    return NOUWII_TRUE;
+}
+
+void nouwii_WriteProfile(nouwii_Instance* instance, const char* path) {
+    instance_MakeCurrent(instance);
+
+    profiler_WriteReport(path);
+}
+
+void nouwii_WriteCoverage(nouwii_Instance* instance, const char* path) {
+    instance_MakeCurrent(instance);
+
+    coverage_WriteReport(path);
+}
+
+pid_t nouwii_Fork(nouwii_Instance* instance) {
+    instance_MakeCurrent(instance);
+
+    // Only the calling thread survives in the child
+    codecache_Suspend();
+    hostio_Suspend();
+
+    // Don't duplicate buffered output
+    fflush(NULL);
 
-    common_Config config;
-    config.pathDol = argv[1];
+    const pid_t pid = fork();
 
-    nouwii_Initialize(&config);
-    nouwii_Reset();
-    nouwii_Run();
-    nouwii_Shutdown();
+    codecache_Resume();
+    hostio_Resume();
 
-    return 0;
+    return pid;
 }
@@ -0,0 +1,286 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "conformance.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/types.h"
+
+#include "core/codecache.h"
+#include "core/memory.h"
+
+#include "hw/broadway.h"
+
+// Vectors use r3/f3 as the destination and r4-r6/f4-f6 as sources
+#define ENCODE_D(opcd, simm)          (((opcd) << 26) | (3 << 21) | (4 << 16) | (simm))
+#define ENCODE_XO(xo, rc)             ((31 << 26) | (3 << 21) | (4 << 16) | (5 << 11) | ((xo) << 1) | (rc))
+#define ENCODE_X(xo, rb, rc)          ((31 << 26) | (4 << 21) | (3 << 16) | ((rb) << 11) | ((xo) << 1) | (rc))
+#define ENCODE_M(opcd, sh, mb, me, rc) (((opcd) << 26) | (4 << 21) | (3 << 16) | ((sh) << 11) | ((mb) << 6) | ((me) << 1) | (rc))
+#define ENCODE_A(xo, rb, rc)          ((63 << 26) | (3 << 21) | (4 << 16) | ((rb) << 11) | ((rc) << 6) | ((xo) << 1))
+#define ENCODE_FX(xo)                 ((63 << 26) | (3 << 21) | (5 << 11) | ((xo) << 1))
+#define ENCODE_PSQL(w)                ((56 << 26) | (3 << 21) | (4 << 16) | ((w) << 15))
+
+// OE forms of XO instructions, these record overflow in XER
+#define XO_OE (1 << 9)
+
+#define CONFORMANCE_ADDR (0x1000)
+
+// Benchmarks run a block of copies of the instruction from here
+#define BENCHMARK_ADDR (0x2000)
+
+#define NUM_BENCHMARK_ITERATIONS (1 << 20)
+
+#define HID2_LSQE (1U << 31)
+#define HID2_PSE  (1U << 29)
+
+enum {
+    CHECK_GPR      = 1 << 0,
+    CHECK_PS0      = 1 << 1,
+    CHECK_PS1      = 1 << 2,
+    CHECK_PS0_WORD = 1 << 3, // Low word of PS0 against the GPR result
+};
+
+typedef struct Vector {
+    const char* name;
+
+    u32 instr;
+
+    // r3-r6 and PS0 of f3-f6 on entry, XER and the two words at CONFORMANCE_ADDR
+    u32 r[4];
+    f64 f[4];
+
+    u32 xer;
+    u32 mem[2];
+
+    // CR and XER are always checked
+    struct {
+        u32 r;
+        f64 ps0, ps1;
+
+        u32 xer;
+        u32 cr;
+    } expected;
+
+    int check;
+} Vector;
+
+// Expected results follow the architecture, not the current implementation
+static const Vector vectors[] = {
+    { "add",       ENCODE_XO(266, 0), { 0, 0x7FFFFFFF, 1 },          {}, 0,          {}, { 0x80000000, 0, 0, 0,          0 },          CHECK_GPR },
+    { "add.",      ENCODE_XO(266, 1), { 0, 0xFFFFFFFF, 1 },          {}, 0x80000000, {}, { 0x00000000, 0, 0, 0x80000000, 0x30000000 }, CHECK_GPR },
+    { "add.",      ENCODE_XO(266, 1), { 0, 1, 1 },                   {}, 0,          {}, { 0x00000002, 0, 0, 0,          0x40000000 }, CHECK_GPR },
+    { "addc",      ENCODE_XO(10, 0),  { 0, 0xFFFFFFFF, 2 },          {}, 0,          {}, { 0x00000001, 0, 0, 0x20000000, 0 },          CHECK_GPR },
+    { "addc",      ENCODE_XO(10, 0),  { 0, 1, 2 },                   {}, 0x20000000, {}, { 0x00000003, 0, 0, 0,          0 },          CHECK_GPR },
+    { "adde",      ENCODE_XO(138, 0), { 0, 0xFFFFFFFF, 0 },          {}, 0x20000000, {}, { 0x00000000, 0, 0, 0x20000000, 0 },          CHECK_GPR },
+    { "adde",      ENCODE_XO(138, 0), { 0, 5, 6 },                   {}, 0x20000000, {}, { 0x0000000C, 0, 0, 0,          0 },          CHECK_GPR },
+    { "addic",     ENCODE_D(12, 0xFFFF),  { 0, 5 },                 {}, 0,          {}, { 0x00000004, 0, 0, 0x20000000, 0 },          CHECK_GPR },
+    { "addic.",    ENCODE_D(13, 0xFFFB),  { 0, 5 },                 {}, 0,          {}, { 0x00000000, 0, 0, 0x20000000, 0x20000000 }, CHECK_GPR },
+    { "subfic",    ENCODE_D(8, 0x0010),   { 0, 3 },                 {}, 0,          {}, { 0x0000000D, 0, 0, 0x20000000, 0 },          CHECK_GPR },
+    { "subfic",    ENCODE_D(8, 0x0002),   { 0, 3 },                 {}, 0,          {}, { 0xFFFFFFFF, 0, 0, 0,          0 },          CHECK_GPR },
+    { "subf",      ENCODE_XO(40, 0),  { 0, 3, 10 },                  {}, 0,          {}, { 0x00000007, 0, 0, 0,          0 },          CHECK_GPR },
+    { "subfc",     ENCODE_XO(8, 0),   { 0, 10, 3 },                  {}, 0,          {}, { 0xFFFFFFF9, 0, 0, 0,          0 },          CHECK_GPR },
+    { "subfc",     ENCODE_XO(8, 0),   { 0, 3, 10 },                  {}, 0,          {}, { 0x00000007, 0, 0, 0x20000000, 0 },          CHECK_GPR },
+    { "subfe",     ENCODE_XO(136, 0), { 0, 5, 10 },                  {}, 0x20000000, {}, { 0x00000005, 0, 0, 0x20000000, 0 },          CHECK_GPR },
+    { "subfe.",    ENCODE_XO(136, 1), { 0, 10, 5 },                  {}, 0x20000000, {}, { 0xFFFFFFFB, 0, 0, 0,          0x80000000 }, CHECK_GPR },
+    { "neg",       ENCODE_XO(104, 0), { 0, 5, 0 },                   {}, 0,          {}, { 0xFFFFFFFB, 0, 0, 0,          0 },          CHECK_GPR },
+    { "mullw",     ENCODE_XO(235, 0), { 0, 0xFFFFFFFE, 3 },          {}, 0,          {}, { 0xFFFFFFFA, 0, 0, 0,          0 },          CHECK_GPR },
+    { "mulhw",     ENCODE_XO(75, 0),  { 0, 0xFFFFFFFE, 3 },          {}, 0,          {}, { 0xFFFFFFFF, 0, 0, 0,          0 },          CHECK_GPR },
+    { "mulhwu",    ENCODE_XO(11, 0),  { 0, 0xFFFFFFFE, 3 },          {}, 0,          {}, { 0x00000002, 0, 0, 0,          0 },          CHECK_GPR },
+    { "divw",      ENCODE_XO(491, 0), { 0, 0xFFFFFFF9, 2 },          {}, 0,          {}, { 0xFFFFFFFD, 0, 0, 0,          0 },          CHECK_GPR },
+    { "divwu",     ENCODE_XO(459, 0), { 0, 0xFFFFFFF9, 2 },          {}, 0,          {}, { 0x7FFFFFFC, 0, 0, 0,          0 },          CHECK_GPR },
+    { "addo",      ENCODE_XO(XO_OE | 266, 0), { 0, 0x7FFFFFFF, 1 },  {}, 0,          {}, { 0x80000000, 0, 0, 0xC0000000, 0 },          CHECK_GPR },
+    { "addo",      ENCODE_XO(XO_OE | 266, 0), { 0, 1, 1 },           {}, 0xC0000000, {}, { 0x00000002, 0, 0, 0x80000000, 0 },          CHECK_GPR },
+    { "addo.",     ENCODE_XO(XO_OE | 266, 1), { 0, 0x7FFFFFFF, 1 },  {}, 0,          {}, { 0x80000000, 0, 0, 0xC0000000, 0x90000000 }, CHECK_GPR },
+    { "addco",     ENCODE_XO(XO_OE | 10, 0),  { 0, 0x80000000, 0x80000000 }, {}, 0, {}, { 0x00000000, 0, 0, 0xE0000000, 0 },          CHECK_GPR },
+    { "addeo",     ENCODE_XO(XO_OE | 138, 0), { 0, 0x7FFFFFFF, 0 },  {}, 0x20000000, {}, { 0x80000000, 0, 0, 0xC0000000, 0 },          CHECK_GPR },
+    { "subfo",     ENCODE_XO(XO_OE | 40, 0),  { 0, 1, 0x80000000 },  {}, 0,          {}, { 0x7FFFFFFF, 0, 0, 0xC0000000, 0 },          CHECK_GPR },
+    { "subfo",     ENCODE_XO(XO_OE | 40, 0),  { 0, 0x80000000, 0 },  {}, 0,          {}, { 0x80000000, 0, 0, 0xC0000000, 0 },          CHECK_GPR },
+    { "subfo",     ENCODE_XO(XO_OE | 40, 0),  { 0, 3, 10 },          {}, 0xC0000000, {}, { 0x00000007, 0, 0, 0x80000000, 0 },          CHECK_GPR },
+    { "nego",      ENCODE_XO(XO_OE | 104, 0), { 0, 0x80000000, 0 },  {}, 0,          {}, { 0x80000000, 0, 0, 0xC0000000, 0 },          CHECK_GPR },
+    { "mullwo",    ENCODE_XO(XO_OE | 235, 0), { 0, 0x00010000, 0x00010000 }, {}, 0, {}, { 0x00000000, 0, 0, 0xC0000000, 0 },          CHECK_GPR },
+    { "mullwo",    ENCODE_XO(XO_OE | 235, 0), { 0, 0xFFFFFFFE, 3 },  {}, 0,          {}, { 0xFFFFFFFA, 0, 0, 0,          0 },          CHECK_GPR },
+    { "divwo",     ENCODE_XO(XO_OE | 491, 0), { 0, 0x80000000, 0xFFFFFFFF }, {}, 0, {}, { 0xFFFFFFFF, 0, 0, 0xC0000000, 0 },          CHECK_GPR },
+    { "divwo",     ENCODE_XO(XO_OE | 491, 0), { 0, 5, 0 },           {}, 0,          {}, { 0x00000000, 0, 0, 0xC0000000, 0 },          CHECK_GPR },
+    { "divwo.",    ENCODE_XO(XO_OE | 491, 1), { 0, 0xFFFFFFF9, 2 },  {}, 0x80000000, {}, { 0xFFFFFFFD, 0, 0, 0x80000000, 0x90000000 }, CHECK_GPR },
+    { "divwuo",    ENCODE_XO(XO_OE | 459, 0), { 0, 5, 0 },           {}, 0,          {}, { 0x00000000, 0, 0, 0xC0000000, 0 },          CHECK_GPR },
+    { "and",       ENCODE_X(28, 5, 0),  { 0, 0xF0F0F0F0, 0xFF00FF00 }, {}, 0,        {}, { 0xF000F000, 0, 0, 0,          0 },          CHECK_GPR },
+    { "or",        ENCODE_X(444, 5, 0), { 0, 0xF0F0F0F0, 0xFF00FF00 }, {}, 0,        {}, { 0xFFF0FFF0, 0, 0, 0,          0 },          CHECK_GPR },
+    { "xor",       ENCODE_X(316, 5, 0), { 0, 0xF0F0F0F0, 0xFF00FF00 }, {}, 0,        {}, { 0x0FF00FF0, 0, 0, 0,          0 },          CHECK_GPR },
+    { "nor",       ENCODE_X(124, 5, 0), { 0, 0xF0F0F0F0, 0xFF00FF00 }, {}, 0,        {}, { 0x000F000F, 0, 0, 0,          0 },          CHECK_GPR },
+    { "andc",      ENCODE_X(60, 5, 0),  { 0, 0xF0F0F0F0, 0xFF00FF00 }, {}, 0,        {}, { 0x00F000F0, 0, 0, 0,          0 },          CHECK_GPR },
+    { "slw",       ENCODE_X(24, 5, 0),  { 0, 0x80000001, 1 },        {}, 0,          {}, { 0x00000002, 0, 0, 0,          0 },          CHECK_GPR },
+    { "slw",       ENCODE_X(24, 5, 0),  { 0, 0x80000001, 32 },       {}, 0,          {}, { 0x00000000, 0, 0, 0,          0 },          CHECK_GPR },
+    { "srw",       ENCODE_X(536, 5, 0), { 0, 0x80000001, 4 },        {}, 0,          {}, { 0x08000000, 0, 0, 0,          0 },          CHECK_GPR },
+    { "sraw",      ENCODE_X(792, 5, 0), { 0, 0x80000001, 4 },        {}, 0,          {}, { 0xF8000000, 0, 0, 0x20000000, 0 },          CHECK_GPR },
+    { "sraw",      ENCODE_X(792, 5, 0), { 0, 0x80000000, 4 },        {}, 0,          {}, { 0xF8000000, 0, 0, 0,          0 },          CHECK_GPR },
+    { "sraw",      ENCODE_X(792, 5, 0), { 0, 0x80000000, 40 },       {}, 0,          {}, { 0xFFFFFFFF, 0, 0, 0x20000000, 0 },          CHECK_GPR },
+    { "srawi",     ENCODE_X(824, 4, 0), { 0, 0xFFFFFFF1 },           {}, 0,          {}, { 0xFFFFFFFF, 0, 0, 0x20000000, 0 },          CHECK_GPR },
+    { "rlwinm",    ENCODE_M(21, 8, 24, 31, 0), { 0, 0x12345678 },    {}, 0,          {}, { 0x00000012, 0, 0, 0,          0 },          CHECK_GPR },
+    { "rlwinm.",   ENCODE_M(21, 0, 0, 0, 1),   { 0, 0x80000000 },    {}, 0,          {}, { 0x80000000, 0, 0, 0,          0x80000000 }, CHECK_GPR },
+    { "rlwimi",    ENCODE_M(20, 16, 0, 15, 0), { 0x1234, 0xABCD },   {}, 0,          {}, { 0xABCD1234, 0, 0, 0,          0 },          CHECK_GPR },
+    { "cntlzw",    ENCODE_X(26, 0, 0),  { 0, 0x00010000 },           {}, 0,          {}, { 0x0000000F, 0, 0, 0,          0 },          CHECK_GPR },
+    { "cntlzw",    ENCODE_X(26, 0, 0),  { 0, 0 },                    {}, 0,          {}, { 0x00000020, 0, 0, 0,          0 },          CHECK_GPR },
+    { "extsb",     ENCODE_X(954, 0, 0), { 0, 0x000000F0 },           {}, 0,          {}, { 0xFFFFFFF0, 0, 0, 0,          0 },          CHECK_GPR },
+    { "extsh",     ENCODE_X(922, 0, 0), { 0, 0x00008000 },           {}, 0,          {}, { 0xFFFF8000, 0, 0, 0,          0 },          CHECK_GPR },
+    { "fadd",      ENCODE_A(21, 5, 0), {}, { 0, 1.5, 2.25 },          0,          {}, { 0, 3.75, 0, 0, 0 },                          CHECK_PS0 },
+    { "fsub",      ENCODE_A(20, 5, 0), {}, { 0, 1.5, 2.25 },          0,          {}, { 0, -0.75, 0, 0, 0 },                         CHECK_PS0 },
+    { "fmul",      ENCODE_A(25, 0, 6), {}, { 0, 1.5, 0, -4.0 },       0,          {}, { 0, -6.0, 0, 0, 0 },                          CHECK_PS0 },
+    { "fdiv",      ENCODE_A(18, 5, 0), {}, { 0, 1.0, 4.0 },           0,          {}, { 0, 0.25, 0, 0, 0 },                          CHECK_PS0 },
+    { "fmadd",     ENCODE_A(29, 5, 6), {}, { 0, 1.5, 0.25, 2.0 },     0,          {}, { 0, 3.25, 0, 0, 0 },                          CHECK_PS0 },
+    { "fmsub",     ENCODE_A(28, 5, 6), {}, { 0, 1.5, 0.25, 2.0 },     0,          {}, { 0, 2.75, 0, 0, 0 },                          CHECK_PS0 },
+    { "fneg",      ENCODE_FX(40),      {}, { 0, 0, 2.25 },            0,          {}, { 0, -2.25, 0, 0, 0 },                         CHECK_PS0 },
+    { "fmr",       ENCODE_FX(72),      {}, { 0, 0, -0.5 },            0,          {}, { 0, -0.5, 0, 0, 0 },                          CHECK_PS0 },
+    { "fctiwz",    ENCODE_FX(15),      {}, { 0, 0, 2.7 },             0,          {}, { 0x00000002, 0, 0, 0, 0 },                    CHECK_PS0_WORD },
+    { "fctiwz",    ENCODE_FX(15),      {}, { 0, 0, -2.7 },            0,          {}, { 0xFFFFFFFE, 0, 0, 0, 0 },                    CHECK_PS0_WORD },
+    { "fctiwz",    ENCODE_FX(15),      {}, { 0, 0, 3e9 },             0,          {}, { 0x7FFFFFFF, 0, 0, 0, 0 },                    CHECK_PS0_WORD },
+    { "psq_l",     ENCODE_PSQL(0), { 0, CONFORMANCE_ADDR }, {}, 0, { 0x3FC00000, 0xC0000000 }, { 0, 1.5, -2.0, 0, 0 },           CHECK_PS0 | CHECK_PS1 },
+    { "psq_l w=1", ENCODE_PSQL(1), { 0, CONFORMANCE_ADDR }, {}, 0, { 0x3FC00000, 0xC0000000 }, { 0, 1.5, 1.0, 0, 0 },            CHECK_PS0 | CHECK_PS1 },
+};
+
+#define NUM_VECTORS ((int)(sizeof(vectors) / sizeof(vectors[0])))
+
+static f64 GetPs(const u64 raw) {
+    f64 n;
+    memcpy(&n, &raw, sizeof(n));
+
+    return n;
+}
+
+static u64 GetRaw(const f64 n) {
+    u64 raw;
+    memcpy(&raw, &n, sizeof(raw));
+
+    return raw;
+}
+
+static void SetUpVector(const Vector* vector) {
+    broadway_State state;
+    broadway_GetState(&state);
+
+    for (int i = 0; i < 4; i++) {
+        state.r[3 + i] = vector->r[i];
+
+        state.fprs[3 + i][0] = GetRaw(vector->f[i]);
+        state.fprs[3 + i][1] = GetRaw(0.0);
+    }
+
+    state.xer = vector->xer;
+    state.cr = 0;
+
+    // Paired single loads dequantize floats, GQRs are zero after reset
+    state.hid2 |= HID2_LSQE | HID2_PSE;
+
+    broadway_SetState(&state);
+
+    memory_Write32(CONFORMANCE_ADDR, vector->mem[0]);
+    memory_Write32(CONFORMANCE_ADDR + sizeof(u32), vector->mem[1]);
+}
+
+static int CheckVector(const Vector* vector) {
+    broadway_State state;
+    broadway_GetState(&state);
+
+    const f64 ps0 = GetPs(state.fprs[3][0]);
+    const f64 ps1 = GetPs(state.fprs[3][1]);
+
+    int passed = (state.xer == vector->expected.xer) && (state.cr == vector->expected.cr);
+
+    if ((vector->check & CHECK_GPR) != 0) {
+        passed = passed && (state.r[3] == vector->expected.r);
+    }
+
+    if ((vector->check & CHECK_PS0) != 0) {
+        passed = passed && (ps0 == vector->expected.ps0);
+    }
+
+    if ((vector->check & CHECK_PS1) != 0) {
+        passed = passed && (ps1 == vector->expected.ps1);
+    }
+
+    if ((vector->check & CHECK_PS0_WORD) != 0) {
+        passed = passed && ((u32)state.fprs[3][0] == vector->expected.r);
+    }
+
+    if (!passed) {
+        printf("Conformance %-10s failed (instruction: %08X)\n", vector->name, vector->instr);
+        printf("Conformance   got      r3: %08X, ps0: %g, ps1: %g, XER: %08X, CR: %08X\n", state.r[3], ps0, ps1, state.xer, state.cr);
+        printf("Conformance   expected r3: %08X, ps0: %g, ps1: %g, XER: %08X, CR: %08X\n", vector->expected.r, vector->expected.ps0, vector->expected.ps1, vector->expected.xer, vector->expected.cr);
+    }
+
+    return passed;
+}
+
+// Times the instruction through the block runner, like compiled guest code runs it
+static f64 BenchmarkVector(const u32 instr) {
+    for (u32 i = 0; i < CODECACHE_MAX_INSTRS; i++) {
+        memory_Write32(BENCHMARK_ADDR + i * sizeof(instr), instr);
+    }
+
+    codecache_Block* block = broadway_CompileBlock(memory_GetPointer(BENCHMARK_ADDR), CODECACHE_MAX_INSTRS);
+
+    broadway_State state;
+    broadway_GetState(&state);
+
+    const u32 numRuns = NUM_BENCHMARK_ITERATIONS / block->numOps;
+
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (u32 i = 0; i < numRuns; i++) {
+        state.ia = BENCHMARK_ADDR;
+
+        broadway_SetState(&state);
+        broadway_RunBlock(block, block->numOps);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    const f64 ns = 1e9 * (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec);
+
+    const u32 numInstrs = numRuns * block->numOps;
+
+    free(block);
+
+    return ns / numInstrs;
+}
+
+int conformance_Run(const int benchmark) {
+    int numFailed = 0;
+
+    for (int i = 0; i < NUM_VECTORS; i++) {
+        const Vector* vector = &vectors[i];
+
+        SetUpVector(vector);
+
+        if (!broadway_Execute(vector->instr)) {
+            printf("Conformance %-10s not implemented (instruction: %08X)\n", vector->name, vector->instr);
+
+            numFailed++;
+
+            continue;
+        }
+
+        if (!CheckVector(vector)) {
+            numFailed++;
+
+            continue;
+        }
+
+        if (benchmark) {
+            SetUpVector(vector);
+
+            printf("Conformance %-10s %8.2f ns\n", vector->name, BenchmarkVector(vector->instr));
+        }
+    }
+
+    printf("Conformance %d/%d vectors passed\n", NUM_VECTORS - numFailed, NUM_VECTORS);
+
+    return numFailed;
+}
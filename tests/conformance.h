@@ -0,0 +1,9 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+// Runs single instructions against golden vectors and optionally times them, returns the number of failures
+int conformance_Run(const int benchmark);
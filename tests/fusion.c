@@ -0,0 +1,231 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "fusion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/types.h"
+
+#include "core/codecache.h"
+#include "core/memory.h"
+
+#include "hw/broadway.h"
+
+#define ENCODE_D(opcd, rd, ra, d)         (((opcd) << 26) | ((rd) << 21) | ((ra) << 16) | ((d) & 0xFFFF))
+#define ENCODE_X(xo, rd, ra, rb)          ((31 << 26) | ((rd) << 21) | ((ra) << 16) | ((rb) << 11) | ((xo) << 1))
+#define ENCODE_M(opcd, rs, ra, sh, mb, me) (((opcd) << 26) | ((rs) << 21) | ((ra) << 16) | ((sh) << 11) | ((mb) << 6) | ((me) << 1))
+#define ENCODE_CMP(opcd, crfd, ra, imm)   (((opcd) << 26) | ((crfd) << 23) | ((ra) << 16) | ((imm) & 0xFFFF))
+#define ENCODE_BC(bo, bi, bd)             ((16 << 26) | ((bo) << 21) | ((bi) << 16) | ((bd) & 0xFFFC))
+
+#define LIS(rd, imm)          ENCODE_D(15, rd, 0, imm)
+#define ADDI(rd, ra, imm)     ENCODE_D(14, rd, ra, imm)
+#define ORI(ra, rs, imm)      ENCODE_D(24, rs, ra, imm)
+#define CMPWI(crfd, ra, imm)  ENCODE_CMP(11, crfd, ra, imm)
+#define CMPLWI(crfd, ra, imm) ENCODE_CMP(10, crfd, ra, imm)
+#define CMPLW(crfd, ra, rb)   ENCODE_X(32, (crfd) << 2, ra, rb)
+#define RLWINM(ra, rs, sh, mb, me) ENCODE_M(21, rs, ra, sh, mb, me)
+#define MFLR(rd)              ENCODE_X(339, rd, 8, 0)
+#define STW(rs, ra, d)        ENCODE_D(36, rs, ra, d)
+#define STWU(rs, ra, d)       ENCODE_D(37, rs, ra, d)
+#define DCBZ(ra, rb)          ENCODE_X(1014, 0, ra, rb)
+
+// bc with BO 12 branches if the CR bit is set, BO 4 if it's clear, BO 16 decrements CTR and branches if it's not zero
+#define BEQ(cr, bd)  ENCODE_BC(12, 4 * (cr) + 2, bd)
+#define BNE(cr, bd)  ENCODE_BC(4, 4 * (cr) + 2, bd)
+#define BDNZ(bd)     ENCODE_BC(16, 0, bd)
+
+#define CODE_ADDR (0x3000)
+
+// Stores and dcbz stay in here, it's restored between runs
+#define DATA_ADDR (0x4000)
+#define SIZE_DATA (0x4000)
+
+#define STACK_ADDR (0x7000)
+
+#define MAX_INSTRS  (8)
+#define MAX_INPUTS  (4)
+
+typedef struct Idiom {
+    const char* name;
+
+    u32 instrs[MAX_INSTRS];
+    u32 numInstrs;
+
+    // Instructions the superinstruction at the start of the block should cover
+    u32 numFused;
+
+    // r3, r4, CTR, LR on entry. Each set is run separately
+    u32 inputs[MAX_INPUTS][4];
+    u32 numInputs;
+} Idiom;
+
+static const Idiom idioms[] = {
+    { "lis+addi",         { LIS(3, 0x1234), ADDI(4, 3, 0x8000) },                     2, 2, { {} },                                   1 },
+    { "lis+addi same",    { LIS(3, 0x8000), ADDI(3, 3, 0x7FFF) },                     2, 2, { {} },                                   1 },
+    { "lis+ori",          { LIS(3, 0x1234), ORI(5, 3, 0xBEEF) },                      2, 2, { {} },                                   1 },
+    { "cmpwi+beq",        { CMPWI(0, 3, 5), BEQ(0, 8), ADDI(4, 4, 1) },               3, 2, { { 5 }, { 4 }, { 0xFFFFFFFF } },         3 },
+    { "cmplw+bne",        { CMPLW(7, 3, 4), BNE(7, 8), ADDI(4, 4, 1) },               3, 2, { { 1, 1 }, { 1, 2 }, { 0xFFFFFFFF, 1 } }, 3 },
+    { "rlwinm+cmplwi",    { RLWINM(4, 3, 0, 28, 31), CMPLWI(0, 4, 3) },               2, 2, { { 0x13 }, { 0xF3 } },                   2 },
+    { "rlwinm+cmpwi+bne", { RLWINM(4, 3, 8, 24, 31), CMPWI(1, 4, 0x12), BNE(1, 8) },  3, 3, { { 0x12345678 }, { 0x13345678 } },       2 },
+    { "mflr+stw",         { MFLR(0), STW(0, 1, 4), ADDI(3, 3, 1) },                   3, 2, { { 0, 0, 0, 0x80001234 } },              1 },
+    { "mflr+stw+stwu",    { MFLR(0), STW(0, 1, 4), STWU(1, 1, -16) },                 3, 3, { { 0, 0, 0, 0x80001234 } },              1 },
+    { "stwu+mflr+stw",    { STWU(1, 1, -16), MFLR(0), STW(0, 1, 20) },                3, 3, { { 0, 0, 0, 0x80001234 } },              1 },
+    { "dcbz loop",        { DCBZ(0, 3), ADDI(3, 3, 32), BDNZ(-8) },                   3, 3, { { DATA_ADDR, 0, 8 }, { DATA_ADDR + 0x10, 0, 200 }, { DATA_ADDR, 0, 1 }, { DATA_ADDR, 0, 0 } }, 4 },
+};
+
+#define NUM_IDIOMS ((int)(sizeof(idioms) / sizeof(idioms[0])))
+
+// Slice lengths each input runs with. 3 is the dcbz loop's cap edge, one iteration has to end the slice
+static const i64 slices[] = { 1, 2, 3, 4, 5, 7, 100 };
+
+#define NUM_SLICES ((int)(sizeof(slices) / sizeof(slices[0])))
+
+static u8 data[SIZE_DATA];
+
+static void SetUp(const Idiom* idiom, const u32* input, broadway_State* state) {
+    broadway_GetState(state);
+
+    memset(state->r, 0, sizeof(state->r));
+
+    state->ia = CODE_ADDR;
+    state->r[1] = STACK_ADDR;
+    state->r[3] = input[0];
+    state->r[4] = input[1];
+    state->ctr = input[2];
+    state->lr = input[3];
+    state->cr = 0;
+    state->xer = 0;
+    state->tbr = 0;
+
+    broadway_SetState(state);
+
+    for (u32 i = 0; i < idiom->numInstrs; i++) {
+        memory_Write32(CODE_ADDR + i * sizeof(u32), idiom->instrs[i]);
+    }
+
+    // Something other than zero, so dcbz shows
+    memset(data, 0xA5, sizeof(data));
+
+    memory_CopyToGuest(DATA_ADDR, data, sizeof(data));
+}
+
+static int Compare(const char* name, const i64 slice, const broadway_State* fused, const broadway_State* unfused) {
+    const char* reg = NULL;
+
+    if (fused->ia != unfused->ia) {
+        reg = "IA";
+    } else if (memcmp(fused->r, unfused->r, sizeof(fused->r)) != 0) {
+        reg = "GPRs";
+    } else if (fused->cr != unfused->cr) {
+        reg = "CR";
+    } else if (fused->xer != unfused->xer) {
+        reg = "XER";
+    } else if ((fused->lr != unfused->lr) || (fused->ctr != unfused->ctr)) {
+        reg = "LR/CTR";
+    } else if (fused->tbr != unfused->tbr) {
+        reg = "time base";
+    } else if ((memcmp(fused->fprs, unfused->fprs, sizeof(fused->fprs)) != 0) || (fused->fpscr != unfused->fpscr)) {
+        reg = "FPRs";
+    } else if ((fused->msr != unfused->msr) || (fused->hid2 != unfused->hid2)) {
+        reg = "MSR/HID2";
+    }
+
+    if (reg == NULL) {
+        return NOUWII_TRUE;
+    }
+
+    printf("Fusion %-16s slice %3lld: %s differ\n", name, (long long)slice, reg);
+    printf("Fusion   fused   IA: %08X, CR: %08X, CTR: %08X, r1: %08X, r3: %08X, r4: %08X\n", fused->ia, fused->cr, fused->ctr, fused->r[1], fused->r[3], fused->r[4]);
+    printf("Fusion   unfused IA: %08X, CR: %08X, CTR: %08X, r1: %08X, r3: %08X, r4: %08X\n", unfused->ia, unfused->cr, unfused->ctr, unfused->r[1], unfused->r[3], unfused->r[4]);
+
+    return NOUWII_FALSE;
+}
+
+static int RunInput(const Idiom* idiom, const codecache_Block* block, const u32* input, const i64 slice) {
+    static u8 result[SIZE_DATA];
+
+    broadway_State start, fused, unfused;
+
+    SetUp(idiom, input, &start);
+
+    broadway_RunBlock(block, slice);
+
+    const i64 cyclesLeft = *broadway_GetCyclesToRun();
+
+    broadway_GetState(&fused);
+
+    memory_CopyFromGuest(result, DATA_ADDR, sizeof(result));
+
+    if (cyclesLeft < 0) {
+        printf("Fusion %-16s slice %3lld: overran the slice by %lld cycles\n", idiom->name, (long long)slice, (long long)-cyclesLeft);
+
+        return NOUWII_FALSE;
+    }
+
+    // The interpreter runs as many instructions as the block claims it did
+    SetUp(idiom, input, &start);
+
+    broadway_Interpret(slice - cyclesLeft);
+
+    broadway_GetState(&unfused);
+
+    memory_CopyFromGuest(data, DATA_ADDR, sizeof(data));
+
+    if (!Compare(idiom->name, slice, &fused, &unfused)) {
+        return NOUWII_FALSE;
+    }
+
+    if (memcmp(result, data, sizeof(data)) != 0) {
+        printf("Fusion %-16s slice %3lld: memory differs\n", idiom->name, (long long)slice);
+
+        return NOUWII_FALSE;
+    }
+
+    return NOUWII_TRUE;
+}
+
+int fusion_Run() {
+    int numFailed = 0;
+    int numRuns = 0;
+
+    for (int i = 0; i < NUM_IDIOMS; i++) {
+        const Idiom* idiom = &idioms[i];
+
+        for (u32 j = 0; j < idiom->numInstrs; j++) {
+            memory_Write32(CODE_ADDR + j * sizeof(u32), idiom->instrs[j]);
+        }
+
+        codecache_Block* block = broadway_CompileBlock(memory_GetPointer(CODE_ADDR), idiom->numInstrs);
+
+        if ((block == NULL) || (block->ops[0].fused == NULL) || (block->ops[0].numFused != idiom->numFused)) {
+            printf("Fusion %-16s wasn't fused into %u instructions\n", idiom->name, idiom->numFused);
+
+            numFailed++;
+
+            free(block);
+
+            continue;
+        }
+
+        for (u32 j = 0; j < idiom->numInputs; j++) {
+            for (int k = 0; k < NUM_SLICES; k++) {
+                if (!RunInput(idiom, block, idiom->inputs[j], slices[k])) {
+                    numFailed++;
+                }
+
+                numRuns++;
+            }
+        }
+
+        free(block);
+    }
+
+    printf("Fusion %d/%d runs matched the interpreter\n", numRuns - numFailed, numRuns);
+
+    return numFailed;
+}
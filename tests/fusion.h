@@ -0,0 +1,10 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+// Runs each superinstruction idiom fused and through the interpreter and compares the results,
+// returns the number of failures
+int fusion_Run();
@@ -0,0 +1,65 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "common/config.h"
+
+#include "core/instance.h"
+#include "core/memory.h"
+
+#include "hw/broadway.h"
+
+#include "nouwii.h"
+
+#include "conformance.h"
+#include "fusion.h"
+#include "stepback.h"
+
+static void PrintUsage() {
+    puts("Usage: nouwii-tests conformance [-b]");
+    puts("       nouwii-tests fusion");
+    puts("       nouwii-tests rewind");
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        PrintUsage();
+        return 1;
+    }
+
+    const common_Config config = {};
+
+    // Tests drive the CPU directly on a freshly reset instance, no DOL is loaded
+    nouwii_Instance* instance = nouwii_Initialize(&config);
+
+    instance_MakeCurrent(instance);
+
+    memory_Reset();
+    broadway_Reset();
+
+    int numFailed;
+
+    if (strcmp(argv[1], "conformance") == 0) {
+        const int benchmark = (argc > 2) && (strcmp(argv[2], "-b") == 0);
+
+        numFailed = conformance_Run(benchmark);
+    } else if (strcmp(argv[1], "fusion") == 0) {
+        numFailed = fusion_Run();
+    } else if (strcmp(argv[1], "rewind") == 0) {
+        numFailed = stepback_Run();
+    } else {
+        PrintUsage();
+
+        nouwii_Shutdown(instance);
+
+        return 1;
+    }
+
+    nouwii_Shutdown(instance);
+
+    return (numFailed == 0) ? 0 : 1;
+}
@@ -0,0 +1,344 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#include "stepback.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/types.h"
+
+#include "core/instance.h"
+#include "core/memory.h"
+#include "core/rewind.h"
+#include "core/scheduler.h"
+
+#include "hw/broadway.h"
+
+#define ADDI(rd, ra, imm) ((14 << 26) | ((rd) << 21) | ((ra) << 16) | ((imm) & 0xFFFF))
+#define B(bd)             ((18 << 26) | ((bd) & 0x3FFFFFC))
+
+// Each program is a loop bumping its own register, so running stale code shows
+#define CODE_ADDR (0x3000)
+
+// Written by the tick event
+#define DATA_ADDR (0x4000)
+
+// A few pages in both MEM1 and MEM2
+#define MEM1_ADDR (0x00800000)
+#define MEM2_ADDR (0x10200000)
+
+#define SIZE_FILL (4 * MEMORY_SIZE_PAGE)
+
+#define SIZE_RAM (MEMORY_NUM_RAM_PAGES * MEMORY_SIZE_PAGE)
+
+// Pages rewritten between snapshots by the budget test, and the budget that holds about two of them
+#define NUM_BUDGET_PAGES    (64)
+#define NUM_BUDGET_CAPTURES (5)
+#define SMALL_BUDGET        (5 * NUM_BUDGET_PAGES * MEMORY_SIZE_PAGE / 2)
+
+typedef struct Checkpoint {
+    broadway_State state;
+
+    i64 timestamp;
+
+    u8* scheduler;
+    usize sizeScheduler;
+
+    u8* ram;
+} Checkpoint;
+
+static u8 fill[SIZE_FILL];
+
+static void Tick(const int arg) {
+    memory_Write32(DATA_ADDR, arg);
+}
+
+// Runs the loop at CODE_ADDR until an event after the given number of cycles
+static void Advance(const i64 cycles) {
+    scheduler_ScheduleEvent("stepback_Tick", Tick, (int)cycles, cycles);
+    scheduler_Run();
+}
+
+static void WriteProgram(const u32 reg, const i32 imm) {
+    memory_Write32(CODE_ADDR, ADDI(reg, reg, imm));
+    memory_Write32(CODE_ADDR + sizeof(u32), B(-4));
+}
+
+static void Fill(const u32 addr, const u8 seed) {
+    for (u32 i = 0; i < SIZE_FILL; i++) {
+        fill[i] = seed + 7 * i + (i >> 9);
+    }
+
+    memory_CopyToGuest(addr, fill, SIZE_FILL);
+}
+
+static void SetRegister(const int reg, const u32 value) {
+    broadway_State state;
+
+    broadway_GetState(&state);
+
+    state.r[reg] = value;
+
+    broadway_SetState(&state);
+}
+
+static void Record(Checkpoint* checkpoint) {
+    broadway_GetState(&checkpoint->state);
+
+    checkpoint->timestamp = scheduler_GetTimestamp();
+
+    const void* scheduler = instance_GetContext(INSTANCE_SCHEDULER, &checkpoint->sizeScheduler);
+
+    checkpoint->scheduler = malloc(checkpoint->sizeScheduler);
+    checkpoint->ram = malloc(SIZE_RAM);
+
+    if ((checkpoint->scheduler == NULL) || (checkpoint->ram == NULL)) {
+        puts("Rewind Failed to allocate checkpoint");
+        exit(1);
+    }
+
+    memcpy(checkpoint->scheduler, scheduler, checkpoint->sizeScheduler);
+
+    for (u32 ramPage = 0; ramPage < MEMORY_NUM_RAM_PAGES; ramPage++) {
+        memcpy(&checkpoint->ram[MEMORY_SIZE_PAGE * ramPage], memory_GetRamPage(ramPage), MEMORY_SIZE_PAGE);
+    }
+}
+
+static void Release(Checkpoint* checkpoint) {
+    free(checkpoint->scheduler);
+    free(checkpoint->ram);
+}
+
+static int CompareStates(const char* name, const broadway_State* state, const broadway_State* expected) {
+    const char* reg = NULL;
+
+    if (state->ia != expected->ia) {
+        reg = "IA";
+    } else if (memcmp(state->r, expected->r, sizeof(state->r)) != 0) {
+        reg = "GPRs";
+    } else if ((state->cr != expected->cr) || (state->xer != expected->xer)) {
+        reg = "CR/XER";
+    } else if ((state->lr != expected->lr) || (state->ctr != expected->ctr)) {
+        reg = "LR/CTR";
+    } else if (state->tbr != expected->tbr) {
+        reg = "time base";
+    } else if ((memcmp(state->fprs, expected->fprs, sizeof(state->fprs)) != 0) || (state->fpscr != expected->fpscr)) {
+        reg = "FPRs";
+    } else if ((state->msr != expected->msr) || (state->hid2 != expected->hid2)) {
+        reg = "MSR/HID2";
+    }
+
+    if (reg == NULL) {
+        return NOUWII_TRUE;
+    }
+
+    printf("Rewind %s: %s differ\n", name, reg);
+    printf("Rewind   got      IA: %08X, r3: %08X, r4: %08X, r5: %08X, r10: %08X\n", state->ia, state->r[3], state->r[4], state->r[5], state->r[10]);
+    printf("Rewind   expected IA: %08X, r3: %08X, r4: %08X, r5: %08X, r10: %08X\n", expected->ia, expected->r[3], expected->r[4], expected->r[5], expected->r[10]);
+
+    return NOUWII_FALSE;
+}
+
+static int Check(const char* name, const Checkpoint* checkpoint) {
+    broadway_State state;
+
+    broadway_GetState(&state);
+
+    if (!CompareStates(name, &state, &checkpoint->state)) {
+        return NOUWII_FALSE;
+    }
+
+    if (scheduler_GetTimestamp() != checkpoint->timestamp) {
+        printf("Rewind %s: timestamp %lld, expected %lld\n", name, (long long)scheduler_GetTimestamp(), (long long)checkpoint->timestamp);
+
+        return NOUWII_FALSE;
+    }
+
+    usize sizeScheduler;
+
+    const void* scheduler = instance_GetContext(INSTANCE_SCHEDULER, &sizeScheduler);
+
+    if ((sizeScheduler != checkpoint->sizeScheduler) || (memcmp(scheduler, checkpoint->scheduler, sizeScheduler) != 0)) {
+        printf("Rewind %s: scheduler state differs\n", name);
+
+        return NOUWII_FALSE;
+    }
+
+    for (u32 ramPage = 0; ramPage < MEMORY_NUM_RAM_PAGES; ramPage++) {
+        if (memcmp(memory_GetRamPage(ramPage), &checkpoint->ram[MEMORY_SIZE_PAGE * ramPage], MEMORY_SIZE_PAGE) != 0) {
+            printf("Rewind %s: RAM page %08X differs\n", name, memory_GetRamPageAddr(ramPage));
+
+            return NOUWII_FALSE;
+        }
+    }
+
+    if (memory_IsCodeProtected(CODE_ADDR)) {
+        // Blocks compiled from the discarded code must go
+        printf("Rewind %s: code page is still protected\n", name);
+
+        return NOUWII_FALSE;
+    }
+
+    return NOUWII_TRUE;
+}
+
+// Two snapshots with RAM, code, registers and scheduler changes around each
+static int RunSnapshots() {
+    int numFailed = 0;
+
+    broadway_State state;
+
+    broadway_GetState(&state);
+
+    memset(state.r, 0, sizeof(state.r));
+
+    state.ia = CODE_ADDR;
+
+    broadway_SetState(&state);
+
+    WriteProgram(3, 1);
+
+    Advance(1000);
+
+    if (!memory_IsCodeProtected(CODE_ADDR)) {
+        puts("Rewind The program wasn't compiled");
+
+        return 1;
+    }
+
+    Checkpoint first, second;
+
+    rewind_Capture();
+
+    Record(&first);
+
+    // Second snapshot: new code, RAM in both banks, a register and a pending event
+    WriteProgram(4, 2);
+    Fill(MEM1_ADDR, 0x11);
+    Fill(MEM2_ADDR, 0x22);
+    SetRegister(10, 0xDEADBEEF);
+
+    scheduler_ScheduleEvent("stepback_Tick", Tick, 0, 1000000);
+
+    Advance(500);
+
+    rewind_Capture();
+
+    Record(&second);
+
+    // What the second program does from here, the rewound instance has to do the same
+    Advance(700);
+
+    broadway_State rerun;
+
+    broadway_GetState(&rerun);
+
+    // Changes nobody should see again
+    WriteProgram(5, 3);
+    Fill(MEM1_ADDR + MEMORY_SIZE_PAGE, 0x33);
+    Fill(MEM2_ADDR, 0x44);
+    SetRegister(10, 0);
+
+    scheduler_ScheduleEvent("stepback_Tick", Tick, 0, 2000000);
+
+    Advance(300);
+
+    if (!rewind_StepBack() || !Check("second snapshot", &second)) {
+        numFailed++;
+    }
+
+    Advance(700);
+
+    broadway_State state2;
+
+    broadway_GetState(&state2);
+
+    if (!CompareStates("rerun", &state2, &rerun)) {
+        numFailed++;
+    }
+
+    // The second step reaches the older snapshot, past both runs
+    if (!rewind_StepBack() || !Check("first snapshot", &first)) {
+        numFailed++;
+    }
+
+    if (rewind_StepBack()) {
+        puts("Rewind Stepped back past the first snapshot");
+
+        numFailed++;
+    }
+
+    Release(&first);
+    Release(&second);
+
+    return numFailed;
+}
+
+// Older snapshots are dropped to stay within the budget, the newer ones still restore
+static int RunBudget() {
+    static u8 pages[NUM_BUDGET_CAPTURES][NUM_BUDGET_PAGES * MEMORY_SIZE_PAGE];
+
+    rewind_SetConfig(0, SMALL_BUDGET);
+    rewind_Reset();
+
+    u32 seed = 1;
+
+    for (int i = 0; i < NUM_BUDGET_CAPTURES; i++) {
+        // Doesn't compress, every capture costs about the size of the pages
+        for (u32 j = 0; j < sizeof(pages[i]); j++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+
+            pages[i][j] = seed;
+        }
+
+        memory_CopyToGuest(MEM2_ADDR, pages[i], sizeof(pages[i]));
+
+        rewind_Capture();
+    }
+
+    int numRestored = 0;
+
+    while (rewind_StepBack()) {
+        const int i = NUM_BUDGET_CAPTURES - 1 - numRestored;
+
+        numRestored++;
+
+        if (memcmp(memory_GetPointer(MEM2_ADDR), pages[i], sizeof(pages[i])) != 0) {
+            printf("Rewind Budget snapshot %d doesn't match\n", i);
+
+            return 1;
+        }
+    }
+
+    if ((numRestored == 0) || (numRestored == NUM_BUDGET_CAPTURES)) {
+        printf("Rewind Budget kept %d/%d snapshots\n", numRestored, NUM_BUDGET_CAPTURES);
+
+        return 1;
+    }
+
+    printf("Rewind Budget kept %d/%d snapshots\n", numRestored, NUM_BUDGET_CAPTURES);
+
+    return 0;
+}
+
+int stepback_Run() {
+    // Snapshots are only captured on request
+    rewind_SetConfig(0, SIZE_RAM);
+
+    scheduler_Reset();
+    rewind_Reset();
+
+    int numFailed = RunSnapshots();
+
+    numFailed += RunBudget();
+
+    printf("Rewind %d failures\n", numFailed);
+
+    return numFailed;
+}
@@ -0,0 +1,10 @@
+/*
+ * nouwii is a Nintendo Wii emulator.
+ * Copyright (C) 2025  noumidev
+ */
+
+#pragma once
+
+// Captures rewind snapshots between runs that change RAM, code, registers and the scheduler,
+// then steps back through them and checks each one is restored exactly. Returns the number of failures
+int stepback_Run();